@@ -0,0 +1,217 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
+#include <chrono>
+#include <co_fsm/headers.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+// Cold-start benchmark: it compares rebuilding a large transition table by add_transition
+// with attaching a memory mapped transition image.
+namespace co_fsm::cold_start
+{
+    enum class automaton_id : std::uint8_t
+    {
+        generated_fsm
+    };
+
+    using event_id = std::uint8_t;
+    using state_id = std::uint32_t;
+
+    std::ostream& operator<< (std::ostream& out, const automaton_id)
+    {
+        out << "generated_fsm";
+        return out;
+    }
+
+    struct event: co_fsm::event_base<event_id>
+    {
+        using co_fsm::event_base<event_id>::set_id;
+
+        std::uint32_t steps_left {};
+    };
+
+    using FSM = automaton<event, state<state_id>, automaton_id>;
+    using Event = FSM::event_type;
+
+    constexpr event_id events_per_state = 8U;
+
+    using clock = std::chrono::steady_clock;
+
+    double elapsed_ms(const clock::time_point start) { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); }
+
+    // Every state emits an event chosen by the number of remaining steps, so a walk visits many states.
+    void state_handler(const FSM&, Event& event)
+    {
+        if (event.steps_left-- != 0U)
+            event.set_id(event_id(event.steps_left % events_per_state));
+        else
+            event.invalidate();
+    }
+
+    void add_states(FSM& fsm, const state_id state_count)
+    {
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm << coroutine(fsm, state_handler).set_id(i);
+    }
+
+    // The coroutines are created when the states are entered for the first time.
+    void add_lazy_states(FSM& fsm, const state_id state_count)
+    {
+        const auto factory = fsm.add_state_factory([](FSM& fsm, const state_id) { return coroutine(fsm, state_handler); });
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm.add_lazy_state(i, factory);
+    }
+
+    // Transition from state i on event e goes to state (i + e + 1) % state_count.
+    void add_transitions(FSM& fsm, const state_id state_count)
+    {
+        for (state_id i = 0U; i < state_count; ++i)
+            for (event_id e = 0U; e < events_per_state; ++e)
+                fsm.add_transition(fsm.state_at(i).handle(), e, fsm.state_at((i + e + 1U) % state_count).handle());
+    }
+
+    std::string read_file(const std::string& path)
+    {
+        std::ifstream in {path, std::ios::binary};
+        return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    }
+
+    state_id walk(FSM& fsm, const std::uint32_t steps)
+    {
+        Event event {};
+        event.set_id(0U);
+        event.steps_left = steps;
+        fsm.go_to(state_id {}).send_event(std::move(event));
+        return fsm.state_id();
+    }
+
+    // The walk of an FSM whose coroutines exist must not allocate; its allocations are added to 'allocations'.
+    state_id counted_walk(FSM& fsm, const std::uint32_t steps, std::uint64_t& allocations)
+    {
+        const co_fsm::no_allocation_guard guard {};
+        const auto end_state = walk(fsm, steps);
+        allocations += guard.allocations();
+        return end_state;
+    }
+}
+
+int main()
+{
+    using namespace co_fsm::cold_start;
+
+#ifdef NDEBUG
+    constexpr state_id state_count = 1U << 17U; // 1M transitions
+    constexpr std::uint32_t walk_steps = 1000000U;
+#else
+    // Reduced due to sanitization overhead.
+    constexpr state_id state_count = 1U << 12U;
+    constexpr std::uint32_t walk_steps = 10000U;
+#endif
+    constexpr std::uint32_t short_walk_steps = 1000U;
+    const auto image_path = (std::filesystem::temp_directory_path() / "co_fsm_cold_start.bin").string();
+    const auto lazy_image_path = (std::filesystem::temp_directory_path() / "co_fsm_cold_start_lazy.bin").string();
+
+    double states_ms {};
+    double rebuild_ms {};
+    double attach_ms {};
+    double lazy_states_ms {};
+    double lazy_attach_ms {};
+    std::size_t lazy_visited_states {};
+    std::size_t lazy_resident_bytes {};
+    std::size_t budget_resident_bytes {};
+    std::uint64_t budget_evictions {};
+    bool lazy_image_matches {};
+    std::uint64_t walk_allocations {};
+    state_id rebuilt_end_state {};
+    state_id mapped_end_state {};
+
+    {
+        FSM fsm {automaton_id::generated_fsm};
+        auto start = clock::now();
+        add_states(fsm, state_count);
+        states_ms = elapsed_ms(start);
+
+        start = clock::now();
+        add_transitions(fsm, state_count);
+        rebuild_ms = elapsed_ms(start);
+
+        co_fsm::write_transition_image(fsm, image_path);
+        rebuilt_end_state = counted_walk(fsm.start(), walk_steps, walk_allocations);
+    }
+
+    {
+        FSM fsm {automaton_id::generated_fsm};
+        add_states(fsm, state_count);
+
+        const auto start = clock::now();
+        const co_fsm::mapped_file file {image_path};
+        fsm.attach_image(co_fsm::transition_image {file.bytes()});
+        attach_ms = elapsed_ms(start);
+
+        mapped_end_state = counted_walk(fsm.start(), walk_steps, walk_allocations);
+    }
+
+    {
+        FSM fsm {automaton_id::generated_fsm};
+        auto start = clock::now();
+        add_lazy_states(fsm, state_count);
+        lazy_states_ms = elapsed_ms(start);
+
+        start = clock::now();
+        const co_fsm::mapped_file file {image_path};
+        fsm.attach_image(co_fsm::transition_image {file.bytes()});
+        lazy_attach_ms = elapsed_ms(start);
+
+        // The image of an FSM whose states have not been created yet is the image it has been given.
+        co_fsm::write_transition_image(fsm, lazy_image_path);
+        lazy_image_matches = read_file(lazy_image_path) == read_file(image_path);
+
+        static_cast<void>(walk(fsm.start(), short_walk_steps));
+        lazy_visited_states = fsm.materialized_state_count();
+        lazy_resident_bytes = fsm.resident_frame_bytes();
+
+        // Walk again keeping at most 100 frames resident.
+        fsm.set_eviction_policy({.frame_budget = 100U * fsm.frame_size(fsm.find_index(fsm.state_id()))});
+        static_cast<void>(walk(fsm, short_walk_steps));
+        budget_resident_bytes = fsm.resident_frame_bytes();
+        budget_evictions = fsm.eviction_count();
+    }
+
+    std::filesystem::remove(image_path);
+    std::filesystem::remove(lazy_image_path);
+
+    using std::cout;
+    cout << std::fixed << std::setprecision(3);
+    cout << "States: " << state_count << ", transitions: " << state_count * events_per_state << '\n';
+    cout << "Adding states:            " << states_ms << " ms\n";
+    cout << "Rebuild by add_transition: " << rebuild_ms << " ms\n";
+    cout << "Mapped image attach:       " << attach_ms << " ms\n";
+    cout << "Adding lazy states:        " << lazy_states_ms << " ms\n";
+    cout << "Mapped image attach:       " << lazy_attach_ms << " ms (lazy states, " << lazy_visited_states
+         << " states created in a walk of " << short_walk_steps << " steps)\n";
+    cout << "Resident frames:           " << lazy_resident_bytes << " bytes, with a budget of 100 frames: " << budget_resident_bytes
+         << " bytes after " << budget_evictions << " evictions\n";
+    if (!lazy_image_matches)
+    {
+        cout << "The image written from the lazy states differs from the original image.\n";
+        return 1;
+    }
+
+    if (rebuilt_end_state != mapped_end_state)
+    {
+        cout << "Walks ended in different states: " << rebuilt_end_state << " vs. " << mapped_end_state << '\n';
+        return 1;
+    }
+
+    if (walk_allocations != 0U)
+    {
+        cout << "The walks of the created states allocated " << walk_allocations << " times.\n";
+        return 1;
+    }
+
+    return 0;
+}
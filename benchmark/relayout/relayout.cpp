@@ -0,0 +1,166 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
+#include <bit>
+#include <chrono>
+#include <co_fsm/headers.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Relayout benchmark: it walks a random graph whose edges are taken with a skewed distribution,
+// renumbers the states by the recorded profile (see automaton::relayout) and walks the same path again.
+namespace co_fsm::relayout
+{
+    enum class automaton_id : std::uint8_t
+    {
+        random_fsm
+    };
+
+    using event_id = std::uint8_t;
+    using state_id = std::uint32_t;
+
+    std::ostream& operator<< (std::ostream& out, const automaton_id)
+    {
+        out << "random_fsm";
+        return out;
+    }
+
+    struct event: co_fsm::event_base<event_id>
+    {
+        using co_fsm::event_base<event_id>::set_id;
+
+        std::uint64_t random {}; // State of the generator which chooses the next event.
+        std::uint32_t steps_left {};
+    };
+
+    using FSM = automaton<event, state<state_id>, automaton_id>;
+    using Event = FSM::event_type;
+
+    constexpr event_id events_per_state = 8U;
+
+    using clock = std::chrono::steady_clock;
+
+    double elapsed_ms(const clock::time_point start) { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); }
+
+    // Event e is emitted with probability ~2^-(e+1), so a few edges of every state take most of the transitions.
+    void state_handler(const FSM&, Event& event)
+    {
+        if (event.steps_left-- == 0U)
+        {
+            event.invalidate();
+            return;
+        }
+
+        event.random ^= event.random << 13U;
+        event.random ^= event.random >> 7U;
+        event.random ^= event.random << 17U;
+        event.set_id(event_id(std::min(std::countr_zero(event.random), events_per_state - 1)));
+    }
+
+    // The states are created lazily, so their frames can be re-created in the new order.
+    void setup(FSM& fsm, const state_id state_count)
+    {
+        const auto factory = fsm.add_state_factory([](FSM& fsm, const state_id) { return coroutine(fsm, state_handler); });
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm.add_lazy_state(i, factory);
+
+        std::mt19937 generator {42U};
+        std::uniform_int_distribution<state_id> target {0U, state_count - 1U};
+        for (state_id i = 0U; i < state_count; ++i)
+            for (event_id e = 0U; e < events_per_state; ++e)
+                fsm.add_transition(i, e, target(generator));
+        fsm.start();
+    }
+
+    state_id walk(FSM& fsm, const std::uint32_t steps)
+    {
+        Event event {};
+        event.set_id(0U);
+        event.random = 0x9E3779B97F4A7C15ULL;
+        event.steps_left = steps;
+        fsm.go_to(state_id {}).send_event(std::move(event));
+        return fsm.state_id();
+    }
+
+    // It returns the fastest of a few walks. The walks visit only resident states, so they must not allocate; the
+    // allocations are added to 'allocations'.
+    double time_walk(FSM& fsm, const std::uint32_t steps, state_id& end_state, std::uint64_t& allocations)
+    {
+        double best {};
+        for (int i = 0; i < 3; ++i)
+        {
+            const co_fsm::no_allocation_guard guard {};
+            const auto start = clock::now();
+            end_state = walk(fsm, steps);
+            const auto ms = elapsed_ms(start);
+            allocations += guard.allocations();
+            best = i == 0 || ms < best ? ms : best;
+        }
+
+        return best;
+    }
+}
+
+int main()
+{
+    using namespace co_fsm::relayout;
+
+#ifdef NDEBUG
+    constexpr state_id state_count = 100000U;
+    constexpr std::uint32_t walk_steps = 2000000U;
+#else
+    // Reduced due to sanitization overhead.
+    constexpr state_id state_count = 10000U;
+    constexpr std::uint32_t walk_steps = 10000U;
+#endif
+    const auto profile_path = (std::filesystem::temp_directory_path() / "co_fsm_relayout.profile").string();
+
+    FSM fsm {automaton_id::random_fsm};
+    setup(fsm, state_count);
+
+    // Record the profile of a run and save it as a later run would find it.
+    fsm.enable_transition_counters();
+    static_cast<void>(walk(fsm, walk_steps));
+    fsm.enable_transition_counters(false);
+    {
+        std::ofstream out(profile_path);
+        co_fsm::write_transition_profile(fsm, out);
+    }
+
+    std::uint64_t walk_allocations {};
+    state_id original_end_state {};
+    const double original_ms = time_walk(fsm, walk_steps, original_end_state, walk_allocations);
+
+    std::ifstream in(profile_path);
+    const auto profile = co_fsm::read_transition_profile<FSM>(in);
+    auto start = clock::now();
+    fsm.relayout(profile, true);
+    const double relayout_ms = elapsed_ms(start);
+
+    state_id relayout_end_state {};
+    const double relayout_walk_ms = time_walk(fsm, walk_steps, relayout_end_state, walk_allocations);
+    std::filesystem::remove(profile_path);
+
+    using std::cout;
+    cout << std::fixed << std::setprecision(3);
+    cout << "States: " << state_count << " (" << fsm.materialized_state_count() << " visited), transitions: "
+         << state_count * events_per_state << ", profiled transitions: " << profile.size() << '\n';
+    cout << "Walk of " << walk_steps << " steps:  " << original_ms << " ms\n";
+    cout << "Relayout:                " << relayout_ms << " ms\n";
+    cout << "Walk after relayout:     " << relayout_walk_ms << " ms (" << std::setprecision(1)
+         << 100.0 * (original_ms - relayout_walk_ms) / original_ms << "% faster)\n";
+    if (original_end_state != relayout_end_state)
+    {
+        cout << "Walks ended in different states: " << original_end_state << " vs. " << relayout_end_state << '\n';
+        return 1;
+    }
+
+    if (walk_allocations != 0U)
+    {
+        cout << "The measured walks allocated " << walk_allocations << " times.\n";
+        return 1;
+    }
+
+    return 0;
+}
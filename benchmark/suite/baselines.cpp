@@ -0,0 +1,321 @@
+#include "scenarios.hpp"
+#include "topologies.hpp"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// FSMs written without co_fsm in the common styles: a switch loop, std::variant + std::visit, a table of function
+// pointers and a table computed at compile time. They run the ring and ping-pong topologies of topologies.hpp and call
+// the same handlers, so the difference to co_fsm is the cost of its dispatch.
+namespace co_fsm::benchmark
+{
+    namespace
+    {
+        using baseline_event = event<>;
+
+        constexpr state_id ring_states = 1024U; // The ring of example/ring has 1023 states and its ready state.
+        constexpr state_id ping = 0U;
+        constexpr state_id pong = 1U;
+        constexpr std::size_t event_count = 3U; // clockwise, to_ping, to_pong
+        constexpr state_id no_state = ~state_id {};
+
+        // The handlers are called without an FSM.
+        struct no_fsm
+        {
+        };
+
+        // It hides the value from the optimizer, so a loop is not folded into its result.
+        template <typename _Value>
+        void opaque(_Value& value) noexcept
+        {
+#if defined(__GNUC__)
+            if constexpr (std::is_integral_v<_Value>)
+                asm volatile("" : "+r"(value));
+            else
+                asm volatile("" : "+m"(value));
+#else
+            volatile auto copy = value;
+            value = copy;
+#endif
+        }
+
+        [[noreturn]] void missing_transition(const state_id state, const baseline_event& event)
+        {
+            throw std::runtime_error("No transition from state " + std::to_string(state) + " on event " + std::to_string(event.id()));
+        }
+
+        // Hand-written switch loop.
+        state_id switch_ring(baseline_event& event)
+        {
+            state_id state {};
+            for (;;)
+            {
+                ring_handler {}(no_fsm {}, event);
+                if (!event.is_valid())
+                    return state;
+
+                switch (event.id())
+                {
+                    case clockwise:
+                        state = state + 1U == ring_states ? 0U : state + 1U;
+                        break;
+                    default:
+                        missing_transition(state, event);
+                }
+
+                opaque(state);
+            }
+        }
+
+        state_id switch_ping_pong(baseline_event& event)
+        {
+            state_id state {ping};
+            for (;;)
+            {
+                ping_pong_handler {}(no_fsm {}, event);
+                if (!event.is_valid())
+                    return state;
+
+                switch (state)
+                {
+                    case ping:
+                        if (event.id() != to_pong)
+                            missing_transition(state, event);
+                        state = pong;
+                        break;
+                    case pong:
+                        if (event.id() != to_ping)
+                            missing_transition(state, event);
+                        state = ping;
+                        break;
+                    default:
+                        missing_transition(state, event);
+                }
+
+                opaque(state);
+            }
+        }
+
+        // States as the alternatives of std::variant; the transition is a visitor which returns the next state.
+        // All states of the ring behave alike, so the ring has a single alternative which holds the position.
+        struct ring_state
+        {
+            state_id index;
+        };
+
+        using ring_variant = std::variant<ring_state>;
+
+        state_id variant_ring(baseline_event& event)
+        {
+            ring_variant state {ring_state {0U}};
+            for (;;)
+            {
+                std::visit([&event](const auto&) { ring_handler {}(no_fsm {}, event); }, state);
+                if (!event.is_valid())
+                    return std::get<ring_state>(state).index;
+
+                state = std::visit(
+                    [&event](const ring_state& item) -> ring_variant
+                    {
+                        if (event.id() != clockwise)
+                            missing_transition(item.index, event);
+                        auto next = item.index + 1U == ring_states ? 0U : item.index + 1U;
+                        opaque(next);
+                        return ring_state {next};
+                    },
+                    state);
+            }
+        }
+
+        struct ping_state
+        {
+        };
+
+        struct pong_state
+        {
+        };
+
+        using ping_pong_variant = std::variant<ping_state, pong_state>;
+
+        struct ping_pong_transition
+        {
+            const baseline_event& event;
+
+            ping_pong_variant operator() (const ping_state&) const
+            {
+                if (event.id() != to_pong)
+                    missing_transition(ping, event);
+                return pong_state {};
+            }
+
+            ping_pong_variant operator() (const pong_state&) const
+            {
+                if (event.id() != to_ping)
+                    missing_transition(pong, event);
+                return ping_state {};
+            }
+        };
+
+        state_id variant_ping_pong(baseline_event& event)
+        {
+            ping_pong_variant state {ping_state {}};
+            for (;;)
+            {
+                std::visit([&event](const auto&) { ping_pong_handler {}(no_fsm {}, event); }, state);
+                if (!event.is_valid())
+                    return state_id(state.index());
+
+                state = std::visit(ping_pong_transition {event}, state);
+                opaque(state);
+            }
+        }
+
+        // Dense table {state, event} -> state built at run time and a handler per state called through a function pointer.
+        struct function_table
+        {
+            using handler = void (*)(baseline_event& event);
+
+            std::vector<handler> handlers;
+            std::vector<state_id> targets; // state * event_count + event -> state (no_state if there is no transition).
+        };
+
+        function_table make_ring_table()
+        {
+            function_table result {std::vector<function_table::handler>(ring_states),
+                                   std::vector<state_id>(ring_states * event_count, no_state)};
+            for (state_id i = 0U; i < ring_states; ++i)
+            {
+                result.handlers[i] = [](baseline_event& event) { ring_handler {}(no_fsm {}, event); };
+                result.targets[i * event_count + clockwise] = (i + 1U) % ring_states;
+            }
+
+            return result;
+        }
+
+        function_table make_ping_pong_table()
+        {
+            function_table result {std::vector<function_table::handler>(2U), std::vector<state_id>(2U * event_count, no_state)};
+            result.handlers[ping] = result.handlers[pong] = [](baseline_event& event) { ping_pong_handler {}(no_fsm {}, event); };
+            result.targets[ping * event_count + to_pong] = pong;
+            result.targets[pong * event_count + to_ping] = ping;
+            return result;
+        }
+
+        state_id run_function_table(const function_table& table, baseline_event& event)
+        {
+            state_id state {};
+            for (;;)
+            {
+                table.handlers[state](event);
+                if (!event.is_valid())
+                    return state;
+
+                const auto next = table.targets[state * event_count + event.id()];
+                if (next == no_state)
+                    missing_transition(state, event);
+                state = next;
+                opaque(state);
+            }
+        }
+
+        // Dense table {state, event} -> state computed at compile time; the handler is known at compile time too.
+        template <state_id _State_count>
+        using static_table = std::array<std::array<state_id, event_count>, _State_count>;
+
+        constexpr auto static_ring_table = []
+        {
+            static_table<ring_states> result {};
+            for (auto& targets: result)
+                targets.fill(no_state);
+            for (state_id i = 0U; i < ring_states; ++i)
+                result[i][clockwise] = (i + 1U) % ring_states;
+            return result;
+        }();
+
+        constexpr auto static_ping_pong_table = []
+        {
+            static_table<2U> result {};
+            for (auto& targets: result)
+                targets.fill(no_state);
+            result[ping][to_pong] = pong;
+            result[pong][to_ping] = ping;
+            return result;
+        }();
+
+        template <const auto& _Table, typename _Handler>
+        state_id run_static_table(baseline_event& event)
+        {
+            state_id state {};
+            for (;;)
+            {
+                _Handler {}(no_fsm {}, event);
+                if (!event.is_valid())
+                    return state;
+
+                const auto next = _Table[state][event.id()];
+                if (next == no_state)
+                    missing_transition(state, event);
+                state = next;
+                opaque(state);
+            }
+        }
+
+        template <typename _Walk>
+        void measure(harness& runner, const char* const topology, const char* const style, const event_id first_event, _Walk&& walk)
+        {
+            const auto steps = (runner.get_options().operations + 1U) & ~std::uint64_t(1U);
+            runner.run("baseline", {{"topology", topology}, {"style", style}}, "transition",
+                       [&](measurement& region)
+                       {
+                           auto event = make_event<fsm<>>(first_event, steps);
+                           region.start();
+                           auto state = walk(event);
+                           region.stop(steps);
+                           opaque(state);
+                       });
+        }
+    }
+
+    void run_baselines(harness& runner)
+    {
+        {
+            fsm<> ring {};
+            build_ring(ring, ring_states);
+            measure(runner, "ring", "co_fsm", clockwise,
+                    [&ring](baseline_event& event)
+                    {
+                        ring.send_event(std::move(event));
+                        return ring.state_id();
+                    });
+        }
+
+        measure(runner, "ring", "switch", clockwise, switch_ring);
+        measure(runner, "ring", "variant", clockwise, variant_ring);
+        const auto ring_table = make_ring_table();
+        measure(runner, "ring", "function_table", clockwise,
+                [&ring_table](baseline_event& event) { return run_function_table(ring_table, event); });
+        measure(runner, "ring", "static_table", clockwise, run_static_table<static_ring_table, ring_handler>);
+
+        {
+            fsm<> ping_pong {};
+            build_ping_pong(ping_pong);
+            measure(runner, "ping_pong", "co_fsm", to_ping,
+                    [&ping_pong](baseline_event& event)
+                    {
+                        ping_pong.send_event(std::move(event));
+                        return ping_pong.state_id();
+                    });
+        }
+
+        measure(runner, "ping_pong", "switch", to_ping, switch_ping_pong);
+        measure(runner, "ping_pong", "variant", to_ping, variant_ping_pong);
+        const auto ping_pong_table = make_ping_pong_table();
+        measure(runner, "ping_pong", "function_table", to_ping,
+                [&ping_pong_table](baseline_event& event) { return run_function_table(ping_pong_table, event); });
+        measure(runner, "ping_pong", "static_table", to_ping, run_static_table<static_ping_pong_table, ping_pong_handler>);
+    }
+}
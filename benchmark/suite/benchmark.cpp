@@ -0,0 +1,52 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
+#include "scenarios.hpp"
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+// Benchmark suite: it measures the time per transition (or per call) of the scenarios in scenarios.hpp.
+// Every case runs once to warm up and then a number of times; the median, the spread and every sample are reported.
+//   benchmark [--repetitions N] [--operations N] [--filter TEXT] [--json FILE|-]
+// The JSON output can be kept per release and compared to find regressions.
+int main(const int argc, const char* const argv[])
+{
+    using namespace co_fsm::benchmark;
+    try
+    {
+        harness runner {options::parse(argc, argv)};
+        run_ring(runner);
+        run_budget(runner);
+        run_status(runner);
+        run_handoff(runner);
+        run_router(runner);
+        run_pipeline(runner);
+        run_multicast(runner);
+        run_send_event(runner);
+        run_payload(runner);
+        run_logger(runner);
+        run_table(runner);
+        run_baselines(runner);
+
+        const auto& json_path = runner.get_options().json_path;
+        if (json_path == "-")
+            runner.write_json(std::cout);
+        else if (!json_path.empty())
+        {
+            std::ofstream out(json_path);
+            runner.write_json(out);
+            if (!out)
+            {
+                std::cerr << "The results can't be written to '" << json_path << "'.\n";
+                return 1;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
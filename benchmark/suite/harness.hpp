@@ -0,0 +1,365 @@
+#pragma once
+#include "perf_counters.hpp"
+
+#include <co_fsm/allocation_guard.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace co_fsm::benchmark
+{
+    // Command line options of the benchmark.
+    struct options
+    {
+#ifdef NDEBUG
+        static inline constexpr std::uint64_t default_operations = 1U << 20U;
+#else
+        // Reduced due to sanitization overhead.
+        static inline constexpr std::uint64_t default_operations = 1U << 14U;
+#endif
+
+        unsigned repetitions {10U};                    // Measured repetitions of every case (after a warm-up run).
+        std::uint64_t operations {default_operations}; // Operations (e.g. transitions) per repetition.
+        std::string filter {};                         // Only the cases whose name contains it are run.
+        std::string json_path {};                      // The results are written as JSON to this file ("-" is stdout).
+        bool hardware_counters {true};                 // The hardware counters are read if they are available.
+
+        // It parses the command line. It throws std::runtime_error if an option is unknown or has no value.
+        static options parse(const int argc, const char* const argv[])
+        {
+            options result {};
+            for (int i = 1; i < argc; ++i)
+            {
+                const std::string_view name {argv[i]};
+                if (name == "--help")
+                {
+                    std::cout << "Usage: " << argv[0] << " [--repetitions N] [--operations N] [--filter TEXT] [--json FILE|-]"
+                              << " [--perf on|off]\n";
+                    std::exit(0);
+                }
+
+                if (i + 1 == argc)
+                    throw std::runtime_error("Option '" + std::string(name) + "' has no value.");
+
+                const std::string value {argv[++i]};
+                if (name == "--repetitions")
+                    result.repetitions = std::max(1U, unsigned(std::stoul(value)));
+                else if (name == "--operations")
+                    result.operations = std::max(std::uint64_t(1U), std::uint64_t(std::stoull(value)));
+                else if (name == "--filter")
+                    result.filter = value;
+                else if (name == "--json")
+                    result.json_path = value;
+                else if (name == "--perf" && (value == "on" || value == "off"))
+                    result.hardware_counters = value == "on";
+                else
+                    throw std::runtime_error("Unknown option '" + std::string(name) + "'. Try --help.");
+            }
+
+            return result;
+        }
+    };
+
+    // Measured region of a repetition. The body of a case prepares its state, calls start() right before the
+    // measured code and stop(operations) right after it. The hardware counters (if any) count only inside the region.
+    // The allocations made by the measuring thread inside the region are counted by a no_allocation_guard (the threads
+    // which a case starts are not seen).
+    class measurement
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        explicit measurement(perf_counters* const counters = nullptr) noexcept: counters_(counters) {}
+
+        void start() noexcept
+        {
+            allocation_guard_.emplace(no_allocation_guard::mode::count);
+            if (counters_ != nullptr)
+                counters_->start();
+            start_ = clock::now();
+        }
+
+        void stop(const std::uint64_t operations) noexcept
+        {
+            const auto end = clock::now();
+            if (counters_ != nullptr)
+                hardware_ = counters_->stop();
+            nanoseconds_ = std::chrono::duration<double, std::nano>(end - start_).count();
+            operations_ = operations;
+            allocations_ = allocation_guard_ ? allocation_guard_->allocations() : 0U;
+            allocation_guard_.reset();
+        }
+
+        double nanoseconds() const noexcept { return nanoseconds_; }
+        std::uint64_t operations() const noexcept { return operations_; }
+        std::uint64_t allocations() const noexcept { return allocations_; }
+        const perf_counters::values& hardware() const noexcept { return hardware_; }
+
+    private:
+        perf_counters* counters_;
+        std::optional<no_allocation_guard> allocation_guard_ {};
+        clock::time_point start_ {};
+        double nanoseconds_ {};
+        std::uint64_t operations_ {};
+        std::uint64_t allocations_ {};
+        perf_counters::values hardware_ {};
+    };
+
+    // Summary of the samples of a case.
+    struct statistics
+    {
+        double min {};
+        double median {};
+        double mean {};
+        double stddev {};
+        double max {};
+
+        static statistics of(std::vector<double> samples)
+        {
+            statistics result {};
+            if (samples.empty())
+                return result;
+
+            std::ranges::sort(samples);
+            const auto size = samples.size();
+            result.min = samples.front();
+            result.max = samples.back();
+            result.median = size % 2U != 0U ? samples[size / 2U] : (samples[size / 2U - 1U] + samples[size / 2U]) / 2.0;
+            result.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / double(size);
+            double sum_of_squares {};
+            for (const auto sample: samples)
+                sum_of_squares += (sample - result.mean) * (sample - result.mean);
+            result.stddev = size > 1U ? std::sqrt(sum_of_squares / double(size - 1U)) : 0.0;
+            return result;
+        }
+    };
+
+    using parameter_list = std::vector<std::pair<std::string, std::string>>; // {name, value} of the parameters of a case.
+    using counter_list = std::vector<std::pair<std::string, double>>;        // {name, value} of the properties of a case.
+
+    // Results of a case: the time per operation of every repetition.
+    struct result
+    {
+        std::string name;
+        parameter_list parameters;
+        std::string unit;  // What an operation is (e.g. "transition").
+        std::uint64_t operations; // Operations per repetition.
+        std::vector<double> samples; // Nanoseconds per operation.
+        statistics nanoseconds;
+        counter_list counters; // Properties of the case (e.g. the number of hash collisions).
+        counter_list hardware; // Hardware counters per operation (medians of the repetitions).
+        std::uint64_t allocations {}; // Allocations of the measuring thread in the measured region (maximum of the repetitions).
+    };
+
+    // It runs the cases, prints a line per case and collects the results.
+    class harness
+    {
+    public:
+        explicit harness(options item): options_(std::move(item))
+        {
+            if (!options_.hardware_counters)
+                return;
+
+            perf_ = std::make_unique<perf_counters>();
+            if (!perf_->available())
+            {
+                std::cerr << "The hardware counters are not available (" << perf_->error() << "); only the time is measured.\n";
+                perf_.reset();
+            }
+            else if (!perf_->error().empty())
+                std::cerr << "Some hardware counters are not available (" << perf_->error() << ").\n";
+        }
+
+        const options& get_options() const noexcept { return options_; }
+
+        // It returns true if the case is selected by the filter (so its set-up is worth doing).
+        bool selected(const std::string& full_name) const
+        {
+            return options_.filter.empty() || full_name.find(options_.filter) != std::string::npos;
+        }
+
+        // It returns "name/key=value/..." of a case.
+        static std::string full_name(const std::string& name, const parameter_list& items)
+        {
+            std::string result {name};
+            for (const auto& [key, value]: items)
+                result += '/' + key + '=' + value;
+            return result;
+        }
+
+        // It runs 'body(measurement&)' once to warm up and then options::repetitions times.
+        // It returns false if the case is not selected.
+        template <typename _Body>
+        bool run(const std::string& name, parameter_list items, const std::string& unit, _Body&& body, counter_list properties = {})
+        {
+            const auto case_name = full_name(name, items);
+            if (!selected(case_name))
+                return false;
+
+            measurement warm_up {perf_.get()};
+            body(warm_up);
+
+            result item {name, std::move(items), unit, 0U, {}, {}, std::move(properties), {}};
+            std::array<std::vector<double>, perf_counters::counter_count> hardware {};
+            for (unsigned i = 0U; i < options_.repetitions; ++i)
+            {
+                measurement region {perf_.get()};
+                body(region);
+                if (region.operations() == 0U)
+                    throw std::runtime_error("Case '" + case_name + "' has measured no operations.");
+                item.operations = region.operations();
+                item.allocations = std::max(item.allocations, region.allocations());
+                item.samples.push_back(region.nanoseconds() / double(region.operations()));
+                for (std::size_t j = 0U; j < perf_counters::counter_count; ++j)
+                    hardware[j].push_back(region.hardware()[j] / double(region.operations()));
+            }
+
+            item.nanoseconds = statistics::of(item.samples);
+            for (std::size_t j = 0U; perf_ && j < perf_counters::counter_count; ++j)
+                if (perf_->available(perf_counters::counter(j)))
+                    item.hardware.emplace_back(perf_counters::names[j], statistics::of(std::move(hardware[j])).median);
+            print(case_name, item);
+            results_.push_back(std::move(item));
+            return true;
+        }
+
+        const std::vector<result>& results() const noexcept { return results_; }
+
+        // It writes the results as a JSON document.
+        void write_json(std::ostream& out) const
+        {
+            const auto flags = out.flags();
+            const auto precision = out.precision();
+            out << std::fixed << std::setprecision(3);
+            out << "{\n  \"context\": {\"compiler\": ";
+            write_string(out, compiler());
+#ifdef NDEBUG
+            out << ", \"build\": \"release\"";
+#else
+            out << ", \"build\": \"debug\"";
+#endif
+            out << ", \"repetitions\": " << options_.repetitions << ", \"operations\": " << options_.operations << "},\n";
+            out << "  \"benchmarks\": [";
+            for (std::size_t i = 0U; i < results_.size(); ++i)
+            {
+                const auto& item = results_[i];
+                out << (i == 0U ? "\n" : ",\n") << "    {\"name\": ";
+                write_string(out, full_name(item.name, item.parameters));
+                out << ", \"scenario\": ";
+                write_string(out, item.name);
+                out << ", \"parameters\": {";
+                for (std::size_t j = 0U; j < item.parameters.size(); ++j)
+                {
+                    out << (j == 0U ? "" : ", ");
+                    write_string(out, item.parameters[j].first);
+                    out << ": ";
+                    write_string(out, item.parameters[j].second);
+                }
+
+                out << "}, \"unit\": ";
+                write_string(out, item.unit);
+                out << ", \"operations\": " << item.operations << ", \"ns_per_operation\": {\"min\": " << item.nanoseconds.min
+                    << ", \"median\": " << item.nanoseconds.median << ", \"mean\": " << item.nanoseconds.mean
+                    << ", \"stddev\": " << item.nanoseconds.stddev << ", \"max\": " << item.nanoseconds.max
+                    << "}, \"allocations\": " << item.allocations << ", \"samples\": [";
+                for (std::size_t j = 0U; j < item.samples.size(); ++j)
+                    out << (j == 0U ? "" : ", ") << item.samples[j];
+                out << "], \"counters\": {";
+                for (std::size_t j = 0U; j < item.counters.size(); ++j)
+                {
+                    out << (j == 0U ? "" : ", ");
+                    write_string(out, item.counters[j].first);
+                    out << ": " << item.counters[j].second;
+                }
+
+                out << "}, \"hardware_counters\": {";
+                for (std::size_t j = 0U; j < item.hardware.size(); ++j)
+                {
+                    out << (j == 0U ? "" : ", ");
+                    write_string(out, item.hardware[j].first);
+                    out << ": " << item.hardware[j].second;
+                }
+
+                out << "}}";
+            }
+
+            out << "\n  ]\n}\n";
+            out.flags(flags);
+            out.precision(precision);
+        }
+
+    private:
+        static void print(const std::string& case_name, const result& item)
+        {
+            const auto flags = std::cout.flags();
+            const auto precision = std::cout.precision();
+            const auto relative_stddev = item.nanoseconds.mean != 0.0 ? 100.0 * item.nanoseconds.stddev / item.nanoseconds.mean : 0.0;
+            std::cout << std::left << std::setw(48) << case_name << std::right << std::fixed << std::setprecision(2) << std::setw(10)
+                      << item.nanoseconds.median << " ns/" << item.unit << "  (min " << item.nanoseconds.min << ", +/- "
+                      << std::setprecision(1) << relative_stddev << "%)";
+            for (const auto& [key, value]: item.counters)
+                std::cout << "  " << key << '=' << std::setprecision(0) << value;
+            if (item.allocations != 0U)
+                std::cout << "  ALLOCATIONS=" << item.allocations;
+            std::cout << '\n';
+            if (!item.hardware.empty())
+            {
+                std::cout << "    per " << item.unit << ':' << std::setprecision(2);
+                for (const auto& [key, value]: item.hardware)
+                    std::cout << ' ' << key << ' ' << value;
+                std::cout << '\n';
+            }
+            std::cout.flags(flags);
+            std::cout.precision(precision);
+        }
+
+        static std::string compiler()
+        {
+#if defined(__clang__)
+            return "clang " __clang_version__;
+#elif defined(__GNUC__)
+            return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+            return "msvc " + std::to_string(_MSC_VER);
+#else
+            return "unknown";
+#endif
+        }
+
+        static void write_string(std::ostream& out, const std::string_view text)
+        {
+            out << '"';
+            for (const char c: text)
+            {
+                if (c == '"' || c == '\\')
+                    out << '\\' << c;
+                else if (static_cast<unsigned char>(c) < 0x20U)
+                    out << ' ';
+                else
+                    out << c;
+            }
+
+            out << '"';
+        }
+
+        options options_;
+        std::unique_ptr<perf_counters> perf_ {}; // Hardware counters (null if they are disabled or unavailable).
+        std::vector<result> results_ {};
+    };
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define CO_FSM_HAS_PERF_EVENTS 1
+#else
+    #define CO_FSM_HAS_PERF_EVENTS 0
+#endif
+
+namespace co_fsm::benchmark
+{
+    // Hardware performance counters of the calling thread read by Linux perf_event_open. They count in user mode only and
+    // only between start() and stop(). A counter which the CPU, the virtual machine or the permissions
+    // (kernel.perf_event_paranoid) don't allow is unavailable; the others are still counted.
+    // The counters are opened separately, so the kernel may multiplex them; the counts are scaled by the time they ran.
+    class perf_counters
+    {
+    public:
+        enum class counter : std::size_t
+        {
+            cycles,
+            instructions,
+            l1d_misses,    // Level 1 data cache read misses.
+            llc_misses,    // Last level cache read misses.
+            dtlb_misses,   // Data TLB read misses.
+            branch_misses, // Mispredicted branches.
+        };
+
+        static inline constexpr std::size_t counter_count = 6U;
+        static inline constexpr std::array<const char*, counter_count> names {
+            "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses",
+        };
+
+        using values = std::array<double, counter_count>;
+
+        perf_counters()
+        {
+            fds_.fill(-1);
+#if CO_FSM_HAS_PERF_EVENTS
+            const auto cache_miss = [](const std::uint64_t cache)
+            { return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8U) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U); };
+            const std::array<std::pair<std::uint32_t, std::uint64_t>, counter_count> events {{
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+                {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)},
+                {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_DTLB)},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            }};
+
+            for (std::size_t i = 0U; i < counter_count; ++i)
+            {
+                perf_event_attr attributes {};
+                attributes.size = sizeof(attributes);
+                attributes.type = events[i].first;
+                attributes.config = events[i].second;
+                attributes.disabled = 1U;
+                attributes.exclude_kernel = 1U;
+                attributes.exclude_hv = 1U;
+                attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                fds_[i] = int(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0UL));
+                if (fds_[i] < 0 && error_.empty())
+                    error_ = std::string(names[i]) + ": " + std::strerror(errno);
+            }
+#else
+            error_ = "perf_event_open is not supported on this platform";
+#endif
+        }
+
+        perf_counters(const perf_counters&) = delete;
+        perf_counters& operator= (const perf_counters&) = delete;
+
+        ~perf_counters()
+        {
+#if CO_FSM_HAS_PERF_EVENTS
+            for (const auto fd: fds_)
+                if (fd >= 0)
+                    ::close(fd);
+#endif
+        }
+
+        // It returns true if the counter can be read.
+        bool available(const counter item) const noexcept { return fds_[std::size_t(item)] >= 0; }
+
+        // It returns true if any counter can be read.
+        bool available() const noexcept
+        {
+            for (const auto fd: fds_)
+                if (fd >= 0)
+                    return true;
+            return false;
+        }
+
+        // It returns why the first unavailable counter couldn't be opened (empty if all counters are available).
+        const std::string& error() const noexcept { return error_; }
+
+        // It resets and enables the counters.
+        void start() noexcept
+        {
+#if CO_FSM_HAS_PERF_EVENTS
+            for (const auto fd: fds_)
+                if (fd >= 0)
+                {
+                    ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+#endif
+        }
+
+        // It disables the counters and returns their counts since start() (zero for the unavailable counters).
+        values stop() noexcept
+        {
+            values result {};
+#if CO_FSM_HAS_PERF_EVENTS
+            for (const auto fd: fds_)
+                if (fd >= 0)
+                    ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+            for (std::size_t i = 0U; i < counter_count; ++i)
+            {
+                std::uint64_t data[3] {}; // value, time enabled, time running
+                if (fds_[i] >= 0 && ::read(fds_[i], data, sizeof(data)) == ssize_t(sizeof(data)) && data[2] != 0U)
+                    result[i] = double(data[0]) * double(data[1]) / double(data[2]);
+            }
+#endif
+            return result;
+        }
+
+    private:
+        std::array<int, counter_count> fds_ {};
+        std::string error_ {};
+    };
+}
@@ -0,0 +1,384 @@
+#include "scenarios.hpp"
+#include "topologies.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace co_fsm::benchmark
+{
+    namespace
+    {
+        // The number of steps of a walk. It is even, so a ping-pong walk ends in the ping state where it started.
+        std::uint64_t walk_steps(const harness& runner) { return (runner.get_options().operations + 1U) & ~std::uint64_t(1U); }
+
+        // It measures walks of 'steps' transitions starting with event 'id' sent to 'fsm'.
+        template <typename _Fsm>
+        void measure_walk(harness& runner, const std::string& name, parameter_list items, _Fsm& fsm, const event_id id,
+                          counter_list properties = {})
+        {
+            const auto steps = walk_steps(runner);
+            runner.run(
+                name, std::move(items), "transition",
+                [&](measurement& region)
+                {
+                    auto event = make_event<_Fsm>(id, steps);
+                    region.start();
+                    fsm.send_event(std::move(event));
+                    region.stop(steps);
+                },
+                std::move(properties));
+        }
+
+        template <std::size_t _Payload_size>
+        void run_payload_case(harness& runner)
+        {
+            const parameter_list items {{"bytes", std::to_string(_Payload_size)}};
+            if (!runner.selected(harness::full_name("payload", items)))
+                return;
+
+            fsm<_Payload_size> ping_pong {};
+            build_ping_pong(ping_pong);
+            measure_walk(runner, "payload", items, ping_pong, to_ping);
+        }
+
+        template <std::size_t... _Payload_sizes>
+        void run_payload_cases(harness& runner, std::index_sequence<_Payload_sizes...>)
+        {
+            (run_payload_case<_Payload_sizes>(runner), ...);
+        }
+
+        // It returns the number of distinct hashes and the size of the largest bucket of the keys of a random table
+        // as std::unordered_map stores them.
+        template <template <typename...> class _Pair>
+        counter_list hash_quality(const state_id state_count)
+        {
+            using key_type = _Pair<std::size_t, event_id>;
+            std::unordered_map<key_type, bool, typename key_type::hash> table {};
+            std::unordered_set<std::size_t> hashes {};
+            for (state_id i = 0U; i < state_count; ++i)
+                for (event_id e = 0U; e < events_per_state; ++e)
+                {
+                    table.emplace(key_type {i, e}, true);
+                    hashes.insert(typename key_type::hash()(key_type {i, e}));
+                }
+
+            std::size_t largest_bucket {};
+            for (std::size_t i = 0U; i < table.bucket_count(); ++i)
+                largest_bucket = std::max(largest_bucket, table.bucket_size(i));
+            return {{"distinct_hashes", double(hashes.size())}, {"largest_bucket", double(largest_bucket)}};
+        }
+
+        template <template <typename...> class _Pair>
+        void run_table_case(harness& runner, const char* const hash_name, const state_id state_count)
+        {
+            const parameter_list items {{"transitions", std::to_string(state_count * events_per_state)}, {"hash", hash_name}};
+            if (!runner.selected(harness::full_name("table", items)))
+                return;
+
+            fsm<0U, _Pair> table {};
+            build_random_table(table, state_count);
+            measure_walk(runner, "table", items, table, event_id {}, hash_quality<_Pair>(state_count));
+        }
+    }
+
+    void run_ring(harness& runner)
+    {
+#ifdef NDEBUG
+        constexpr std::array<state_id, 7U> state_counts {2U, 16U, 128U, 1024U, 16384U, 131072U, 1048576U};
+#else
+        // Reduced due to sanitization overhead.
+        constexpr std::array<state_id, 5U> state_counts {2U, 16U, 128U, 1024U, 16384U};
+#endif
+        for (const auto state_count: state_counts)
+        {
+            const parameter_list items {{"states", std::to_string(state_count)}};
+            if (!runner.selected(harness::full_name("ring", items)))
+                continue;
+
+            fsm<> ring {};
+            build_ring(ring, state_count);
+            measure_walk(runner, "ring", items, ring, clockwise);
+        }
+    }
+
+    void run_budget(harness& runner)
+    {
+        constexpr std::array<std::uint64_t, 4U> budgets {0U, 16U, 256U, 4096U};
+        for (const auto budget: budgets)
+        {
+            const parameter_list items {{"budget", budget == 0U ? std::string("none") : std::to_string(budget)}};
+            if (!runner.selected(harness::full_name("budget", items)))
+                continue;
+
+            fsm<> ring {};
+            build_ring(ring, 1024U);
+            ring.set_transition_budget(budget);
+            const auto steps = walk_steps(runner);
+            runner.run("budget", items, "transition",
+                       [&](measurement& region)
+                       {
+                           auto event = make_event<fsm<>>(clockwise, steps);
+                           region.start();
+                           ring.send_event(std::move(event));
+                           while (ring.is_paused())
+                               ring.resume();
+                           region.stop(steps);
+                       });
+        }
+    }
+
+    void run_status(harness& runner)
+    {
+        constexpr std::array<const char*, 3U> modes {"off", "on", "reader"};
+        for (const auto* const mode: modes)
+        {
+            const parameter_list items {{"status", mode}};
+            if (!runner.selected(harness::full_name("status", items)))
+                continue;
+
+            fsm<> ring {};
+            build_ring(ring, 1024U);
+            ring.enable_status(mode != std::string_view("off"));
+
+            // The reader polls the status as a monitoring thread does (it competes for the cache line of the status).
+            std::atomic_bool done {};
+            std::thread reader {};
+            if (mode == std::string_view("reader"))
+                reader = std::thread(
+                    [&]
+                    {
+                        while (!done.load(std::memory_order_relaxed))
+                            static_cast<void>(ring.status());
+                    });
+
+            measure_walk(runner, "status", items, ring, clockwise);
+            done.store(true, std::memory_order_relaxed);
+            if (reader.joinable())
+                reader.join();
+        }
+    }
+
+    void run_router(harness& runner)
+    {
+        // Every event makes a short walk on the ring of its session, so the shards do more work per event than the producer.
+        constexpr state_id states_per_session = 16U;
+        constexpr std::uint64_t steps_per_event = 64U;
+        constexpr std::uint32_t session_count = 4096U;
+        using session = fsm<>;
+        using router = sharded_router<session, std::uint32_t>;
+
+        std::vector<std::size_t> shard_counts {};
+        const std::size_t cores = std::max(1U, std::thread::hardware_concurrency());
+        for (std::size_t count = 1U; count < cores; count *= 2U)
+            shard_counts.push_back(count);
+        shard_counts.push_back(cores);
+
+        for (const auto shard_count: shard_counts)
+        {
+            const parameter_list items {{"shards", std::to_string(shard_count)}};
+            if (!runner.selected(harness::full_name("router", items)))
+                continue;
+
+            typename router::options settings {};
+            settings.shard_count = shard_count;
+            settings.pin_threads = true;
+            router sessions {settings,
+                             [](const std::uint32_t)
+                             {
+                                 auto result = std::make_unique<session>();
+                                 build_ring(*result, states_per_session);
+                                 return result;
+                             }};
+
+            // A single producer (this thread) sends the events round-robin to the sessions.
+            auto& producer = sessions.producer_at(0U);
+            const auto events = std::max(runner.get_options().operations / steps_per_event, std::uint64_t(1U));
+            runner.run("router", items, "event",
+                       [&](measurement& region)
+                       {
+                           region.start();
+                           for (std::uint64_t i = 0U; i < events; ++i)
+                               producer.send(std::uint32_t(i % session_count), make_event<session>(clockwise, steps_per_event));
+                           sessions.flush();
+                           region.stop(events);
+                       });
+        }
+    }
+
+    void run_pipeline(harness& runner)
+    {
+        // Every stage makes a short walk on its ring per event, so a stage does as much work as the others.
+        constexpr std::size_t stage_count = 3U;
+        constexpr state_id states_per_stage = 16U;
+        constexpr std::uint64_t steps_per_stage = 64U;
+        using stage = fsm<>;
+
+        const auto events = std::max(runner.get_options().operations / (stage_count * steps_per_stage), std::uint64_t(1U));
+        const auto measure = [&](const std::string& threads, stage& first, auto&& flush)
+        {
+            runner.run("pipeline", {{"threads", threads}}, "event",
+                       [&](measurement& region)
+                       {
+                           region.start();
+                           // The first stage pauses if the channel of the second one is full.
+                           for (std::uint64_t i = 0U; i < events; ++i)
+                               first.send_event(make_event<stage>(clockwise, stage_count * steps_per_stage)).wait_for_channel();
+                           flush();
+                           region.stop(events);
+                       });
+        };
+
+        std::vector<std::unique_ptr<stage>> stages {};
+        std::vector<stage*> items {};
+        const auto build = [&]
+        {
+            stages.clear();
+            items.clear();
+            for (std::size_t i = 0U; i < stage_count; ++i)
+                items.push_back(stages.emplace_back(std::make_unique<stage>()).get());
+            build_pipeline(items, states_per_stage, steps_per_stage);
+        };
+
+        // The stages hand off to each other on this thread.
+        if (runner.selected(harness::full_name("pipeline", {{"threads", "1"}})))
+        {
+            build();
+            measure("1", *items.front(), [] {});
+        }
+
+        // This thread runs the first stage; the others run on their own threads and are fed by channels.
+        const auto threads = std::to_string(stage_count);
+        if (runner.selected(harness::full_name("pipeline", {{"threads", threads}})))
+        {
+            build();
+            using threaded_stage = pipeline_stage<stage>;
+            std::vector<std::unique_ptr<threaded_stage>> threaded {};
+            for (std::size_t i = 1U; i < stage_count; ++i)
+                threaded.push_back(std::make_unique<threaded_stage>(*items[i], threaded_stage::options {.core = i}));
+            measure(threads, *items.front(),
+                    [&]
+                    {
+                        for (const auto& item: threaded)
+                            item->flush();
+                    });
+        }
+    }
+
+    void run_multicast(harness& runner)
+    {
+        // Every session suspends on the event at once, so the cost of the fan-out is measured.
+        constexpr std::size_t session_count = 65536U;
+        using session = fsm<>;
+
+        std::vector<std::unique_ptr<session>> sessions {};
+        std::vector<session*> items {};
+        for (std::size_t i = 0U; i < session_count; ++i)
+        {
+            auto& item = *sessions.emplace_back(std::make_unique<session>());
+            item << coroutine(item, sink_handler {}).set_id(0U);
+            item.start().go_to(state_id {});
+            items.push_back(&item);
+        }
+
+        const auto event = make_event<session>(clockwise, 0U);
+        runner.run("multicast", {{"threads", "loop"}}, "fsm",
+                   [&](measurement& region)
+                   {
+                       region.start();
+                       for (auto* const item: items)
+                           item->send_event(session::event_type(event));
+                       region.stop(session_count);
+                   });
+
+        std::vector<std::size_t> thread_counts {};
+        const std::size_t cores = std::max(1U, std::thread::hardware_concurrency());
+        for (std::size_t count = 1U; count < cores; count *= 2U)
+            thread_counts.push_back(count);
+        thread_counts.push_back(cores);
+
+        for (const auto thread_count: thread_counts)
+        {
+            const parameter_list cases {{"threads", std::to_string(thread_count)}};
+            if (!runner.selected(harness::full_name("multicast", cases)))
+                continue;
+
+            multicast_pool pool {{.thread_count = thread_count, .pin_threads = true}};
+            runner.run("multicast", cases, "fsm",
+                       [&](measurement& region)
+                       {
+                           region.start();
+                           pool.send<session>(items, event);
+                           region.stop(session_count);
+                       });
+        }
+    }
+
+    void run_handoff(harness& runner)
+    {
+        {
+            fsm<> ping_pong {};
+            build_ping_pong(ping_pong);
+            measure_walk(runner, "handoff", {{"fsms", "1"}}, ping_pong, to_ping);
+        }
+
+        fsm<> ping {automaton_id::first};
+        fsm<> pong {automaton_id::second};
+        build_handoff(ping, pong);
+        measure_walk(runner, "handoff", {{"fsms", "2"}}, ping, to_ping);
+    }
+
+    void run_send_event(harness& runner)
+    {
+        fsm<> sink {};
+        sink << coroutine(sink, sink_handler {}).set_id(0U);
+        sink.start().go_to(state_id {});
+
+        const auto calls = runner.get_options().operations;
+        runner.run("send_event", {{"transitions", "0"}}, "call",
+                   [&](measurement& region)
+                   {
+                       region.start();
+                       for (std::uint64_t i = 0U; i < calls; ++i)
+                           sink.send_event(make_event<fsm<>>(clockwise, 0U));
+                       region.stop(calls);
+                   });
+    }
+
+    void run_payload(harness& runner) { run_payload_cases(runner, std::index_sequence<0U, 8U, 16U, 32U, 64U, 128U, 256U> {}); }
+
+    void run_logger(harness& runner)
+    {
+        fsm<> ping_pong {};
+        build_ping_pong(ping_pong);
+        measure_walk(runner, "logger", {{"logger", "off"}}, ping_pong, to_ping);
+
+        // The logger does as little as possible, so the cost of calling it is measured.
+        std::uint64_t logged {};
+        ping_pong.set_logger([&logged](automaton_id, automaton_id, state_id, event_id, state_id) { ++logged; });
+        measure_walk(runner, "logger", {{"logger", "on"}}, ping_pong, to_ping);
+    }
+
+    void run_table(harness& runner)
+    {
+#ifdef NDEBUG
+        constexpr std::array<state_id, 6U> state_counts {128U, 512U, 2048U, 8192U, 32768U, 131072U};
+#else
+        // Reduced due to sanitization overhead.
+        constexpr std::array<state_id, 3U> state_counts {128U, 512U, 2048U};
+#endif
+        for (const auto state_count: state_counts)
+        {
+            run_table_case<default_state_handle_event_id_pair>(runner, "default", state_count);
+            run_table_case<mixed_state_handle_event_id_pair>(runner, "mixed", state_count);
+        }
+    }
+}
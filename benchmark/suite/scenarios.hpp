@@ -0,0 +1,43 @@
+#pragma once
+#include "harness.hpp"
+
+// Scenarios of the benchmark. Every scenario runs a few cases with the harness.
+namespace co_fsm::benchmark
+{
+    // Transitions within an FSM on rings of 2 to 1M states.
+    void run_ring(harness& runner);
+
+    // Events of 4096 sessions (rings of 16 states, 64 transitions per event) routed by a sharded router to 1 to all cores.
+    void run_router(harness& runner);
+
+    // Events of a pipeline of 3 FSMs (rings of 16 states, 64 transitions per event in every FSM) run by one thread with
+    // handoffs and by a thread per FSM with channels between them.
+    void run_pipeline(harness& runner);
+
+    // Cost per FSM of sending an event to 65536 FSMs by a loop of send_event calls and by a multicast pool of 1 to all cores.
+    void run_multicast(harness& runner);
+
+    // Transitions within an FSM and handoffs between two FSMs on the ping-pong topology.
+    void run_handoff(harness& runner);
+
+    // Transitions on a ring of 1024 states sliced by transition budgets (a resume call per slice).
+    void run_budget(harness& runner);
+
+    // Transitions on a ring of 1024 states with the status disabled, enabled and enabled with a thread which reads it.
+    void run_status(harness& runner);
+
+    // Cost of a send_event call whose state suspends the FSM at once.
+    void run_send_event(harness& runner);
+
+    // Transitions of ping-pong with event payloads of 0 to 256 bytes.
+    void run_payload(harness& runner);
+
+    // Transitions of ping-pong with and without a logger.
+    void run_logger(harness& runner);
+
+    // The ring and ping-pong of co_fsm and of FSMs written in other styles (switch loop, std::variant, tables).
+    void run_baselines(harness& runner);
+
+    // Random walks on transition tables of 1k to 1M transitions hashed by the default hash and by a mixing hash.
+    void run_table(harness& runner);
+}
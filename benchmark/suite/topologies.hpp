@@ -0,0 +1,240 @@
+#pragma once
+#include <array>
+#include <co_fsm/headers.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// FSMs measured by the benchmark. The ring and ping-pong topologies are the ones of example/ring and example/ping-pong;
+// every state counts down the steps of the event, so a run makes an exact number of transitions.
+namespace co_fsm::benchmark
+{
+    enum class automaton_id : std::uint8_t
+    {
+        first,
+        second,
+    };
+
+    inline std::ostream& operator<< (std::ostream& out, const automaton_id item)
+    {
+        out << (item == automaton_id::first ? "first" : "second");
+        return out;
+    }
+
+    using event_id = std::uint8_t;
+    using state_id = std::uint32_t;
+
+    constexpr event_id clockwise = 0U;        // Event of the ring.
+    constexpr event_id to_ping = 1U;          // Events of ping-pong.
+    constexpr event_id to_pong = 2U;
+    constexpr event_id to_next_stage = 3U;    // Event of a pipeline.
+    constexpr event_id events_per_state = 8U; // Events of every state of the random tables.
+
+    // Event with a payload of _Payload_size bytes besides its id and its counters.
+    template <std::size_t _Payload_size = 0U>
+    struct event: co_fsm::event_base<event_id>
+    {
+        using co_fsm::event_base<event_id>::set_id;
+
+        std::uint64_t steps_left {}; // Transitions to make before the FSM suspends.
+        std::uint64_t random {};     // State of the generator which chooses the next event of a random walk.
+        std::array<unsigned char, _Payload_size> payload {};
+    };
+
+    // Pair "state index - event id" whose hash mixes both values (see default_state_handle_event_id_pair for the default hash).
+    template <typename _State_index_type, typename _Event_id_type>
+    struct mixed_state_handle_event_id_pair: default_state_handle_event_id_pair<_State_index_type, _Event_id_type>
+    {
+        using base = default_state_handle_event_id_pair<_State_index_type, _Event_id_type>;
+
+        using base::base;
+
+        struct hash
+        {
+            std::size_t operator() (const mixed_state_handle_event_id_pair& pair) const noexcept
+            {
+                // The finalizer of splitmix64.
+                auto x = std::uint64_t(pair.first) * 0x9E3779B97F4A7C15ULL + detail::to_integer(pair.second);
+                x = (x ^ (x >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27U)) * 0x94D049BB133111EBULL;
+                return std::size_t(x ^ (x >> 31U));
+            }
+        };
+    };
+
+    template <std::size_t _Payload_size = 0U, template <typename...> class _Pair = default_state_handle_event_id_pair>
+    using fsm = automaton<event<_Payload_size>, state<state_id>, automaton_id, _Pair>;
+
+    // It writes into the payload, so the payload is live.
+    template <typename _Event>
+    void touch(_Event& event) noexcept
+    {
+        if constexpr (std::tuple_size_v<decltype(_Event::payload)> != 0U)
+            ++event.payload[0];
+    }
+
+    // State of the ring: it passes the event on to the next state.
+    struct ring_handler
+    {
+        template <typename _Fsm, typename _Event>
+        void operator() (const _Fsm&, _Event& event) const noexcept
+        {
+            if (event.steps_left-- == 0U)
+                event.invalidate();
+            else
+                touch(event);
+        }
+    };
+
+    // State of ping-pong: it answers to_ping with to_pong and vice versa.
+    struct ping_pong_handler
+    {
+        template <typename _Fsm, typename _Event>
+        void operator() (const _Fsm&, _Event& event) const noexcept
+        {
+            if (event.steps_left-- == 0U)
+                event.invalidate();
+            else
+            {
+                event.set_id(event.id() == to_ping ? to_pong : to_ping);
+                touch(event);
+            }
+        }
+    };
+
+    // State of a random table: it emits a pseudo-random event.
+    struct random_walk_handler
+    {
+        template <typename _Fsm, typename _Event>
+        void operator() (const _Fsm&, _Event& event) const noexcept
+        {
+            if (event.steps_left-- == 0U)
+            {
+                event.invalidate();
+                return;
+            }
+
+            event.random ^= event.random << 13U;
+            event.random ^= event.random >> 7U;
+            event.random ^= event.random << 17U;
+            event.set_id(event_id(event.random % events_per_state));
+        }
+    };
+
+    // State of a pipeline stage: it passes the event on to the next state and, every 'steps_per_stage' steps, to the
+    // next stage.
+    struct stage_handler
+    {
+        std::uint64_t steps_per_stage {};
+
+        template <typename _Fsm, typename _Event>
+        void operator() (const _Fsm&, _Event& event) const noexcept
+        {
+            if (--event.steps_left == 0U)
+                event.invalidate();
+            else
+            {
+                event.set_id(event.steps_left % steps_per_stage == 0U ? to_next_stage : clockwise);
+                touch(event);
+            }
+        }
+    };
+
+    // State which suspends the FSM on every event, so only the cost of send_event is left.
+    struct sink_handler
+    {
+        template <typename _Fsm, typename _Event>
+        void operator() (const _Fsm&, _Event& event) const noexcept
+        {
+            event.invalidate();
+        }
+    };
+
+    // Ring of 'state_count' states: state i goes to state (i + 1) % state_count on event clockwise.
+    template <typename _Fsm>
+    void build_ring(_Fsm& fsm, const state_id state_count)
+    {
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm << coroutine(fsm, ring_handler {}).set_id(i);
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm.add_transition(fsm.state_at(i).handle(), clockwise, fsm.state_at((i + 1U) % state_count).handle());
+        fsm.start().go_to(state_id {});
+    }
+
+    // Ping-pong: state 0 (ping) goes to state 1 (pong) on to_pong, state 1 goes to state 0 on to_ping.
+    template <typename _Fsm>
+    void build_ping_pong(_Fsm& fsm)
+    {
+        fsm << coroutine(fsm, ping_pong_handler {}).set_id(0U) << coroutine(fsm, ping_pong_handler {}).set_id(1U);
+        fsm.add_transition(0U, to_pong, 1U);
+        fsm.add_transition(1U, to_ping, 0U);
+        fsm.start().go_to(state_id {});
+    }
+
+    // Ping-pong between two FSMs: every transition is a handoff to the other FSM.
+    template <typename _Fsm>
+    void build_handoff(_Fsm& ping, _Fsm& pong)
+    {
+        ping << coroutine(ping, ping_pong_handler {}).set_id(0U);
+        pong << coroutine(pong, ping_pong_handler {}).set_id(0U);
+        ping.add_transition(ping.state_at(0U).handle(), to_pong, pong.state_at(0U).handle(), &pong);
+        pong.add_transition(pong.state_at(0U).handle(), to_ping, ping.state_at(0U).handle(), &ping);
+        ping.start().go_to(state_id {});
+        pong.start().go_to(state_id {});
+    }
+
+    // Pipeline of stages: every stage is a ring of 'state_count' states and every state goes to state 0 of the next stage
+    // on to_next_stage. An event of stages.size() * steps_per_stage steps makes steps_per_stage steps in every stage.
+    template <typename _Fsm>
+    void build_pipeline(const std::vector<_Fsm*>& stages, const state_id state_count, const std::uint64_t steps_per_stage)
+    {
+        for (auto* const stage: stages)
+            for (state_id i = 0U; i < state_count; ++i)
+                *stage << coroutine(*stage, stage_handler {steps_per_stage}).set_id(i);
+
+        for (std::size_t s = 0U; s < stages.size(); ++s)
+        {
+            auto& stage = *stages[s];
+            for (state_id i = 0U; i < state_count; ++i)
+            {
+                stage.add_transition(stage.state_at(i).handle(), clockwise, stage.state_at((i + 1U) % state_count).handle());
+                if (s + 1U < stages.size())
+                    stage.add_transition(stage.state_at(i).handle(), to_next_stage, stages[s + 1U]->state_at(0U).handle(),
+                                         stages[s + 1U]);
+            }
+        }
+
+        for (auto* const stage: stages)
+            stage->start().go_to(state_id {});
+    }
+
+    // Random table of state_count * events_per_state transitions: every event of every state goes to a pseudo-random state.
+    template <typename _Fsm>
+    void build_random_table(_Fsm& fsm, const state_id state_count)
+    {
+        for (state_id i = 0U; i < state_count; ++i)
+            fsm << coroutine(fsm, random_walk_handler {}).set_id(i);
+
+        std::uint64_t random {0x2545F4914F6CDD1DULL};
+        for (state_id i = 0U; i < state_count; ++i)
+            for (event_id e = 0U; e < events_per_state; ++e)
+            {
+                random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+                fsm.add_transition(fsm.state_at(i).handle(), e, fsm.state_at(state_id((random >> 33U) % state_count)).handle());
+            }
+
+        fsm.start().go_to(state_id {});
+    }
+
+    // It returns an event which makes 'steps' transitions.
+    template <typename _Fsm>
+    typename _Fsm::event_type make_event(const event_id id, const std::uint64_t steps)
+    {
+        typename _Fsm::event_type result {};
+        result.set_id(id);
+        result.steps_left = steps;
+        result.random = 0x9E3779B97F4A7C15ULL;
+        return result;
+    }
+}
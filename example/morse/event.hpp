@@ -1,6 +1,8 @@
 #pragma once
 #include "morse.hpp"
 #include <co_fsm/headers.hpp>
+#include <span>
+#include <string_view>
 #include <variant>
 
 namespace co_fsm::morse
@@ -9,10 +11,10 @@ namespace co_fsm::morse
     {
         using co_fsm::event_base<event_id>::set_id;
 
-        std::variant<std::string, const std::string_view*, std::uint32_t> data {};
+        // The message is held in a buffer of the payload pool, so sending a message doesn't allocate once the pool is warm.
+        std::variant<co_fsm::pooled_buffer, const std::string_view*, std::uint32_t> data {};
 
-        const std::string& message() const { return std::get<std::string>(data); }
-        std::string& message() { return std::get<std::string>(data); }
+        co_fsm::pooled_buffer& message() { return std::get<co_fsm::pooled_buffer>(data); }
 
         const std::string_view& symbol() const { return *std::get<const std::string_view*>(data); }
 
@@ -24,10 +26,17 @@ namespace co_fsm::morse
             data = {};
         }
 
-        void set_message(const event_id id, std::string message)
+        // It invalidates the event and returns its message buffer (if any) to the pool.
+        void invalidate() noexcept
+        {
+            co_fsm::event_base<event_id>::invalidate();
+            data = {};
+        }
+
+        void set_message(const event_id id, const std::string_view message)
         {
             set_id(id);
-            data = std::move(message);
+            data = co_fsm::pooled_buffer {std::as_bytes(std::span {message})};
         }
 
         void set_symbol(const event_id id, const std::string_view& symbol) noexcept
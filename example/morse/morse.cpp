@@ -1,3 +1,4 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
 #include "simple_logger.hpp"
 #include "sound_controller.hpp"
 #include "sound_on_state_handler.hpp"
@@ -86,7 +87,10 @@ int main()
     {
         std::cout << "Message = '" << message << "'\n";
         event.set_message(event_id::transmit_message, message);
-        fsm.send_event(std::move(event));
+        {
+            const co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap}; // The transitions must not allocate.
+            fsm.send_event(std::move(event));
+        }
     }
 
     std::cout << "\n'" << fsm.id() << "' is suspended at state '" << fsm.state_id() << "'\n";
@@ -20,7 +20,7 @@ namespace co_fsm::morse
         {
             case event_id::transmit_message:
             {
-                // Take the string from the event data and store.
+                // Take the message buffer from the event data and store. The previous buffer returns to the pool.
                 message_ = std::move(event.message());
                 symbols_sent_ = {};
                 break;
@@ -43,7 +43,7 @@ namespace co_fsm::morse
 
         if (symbols_sent_ < message_.size())
         {
-            const char upper_case_symbol = std::toupper(message_[symbols_sent_]);
+            const char upper_case_symbol = std::toupper(message_.as<const char>()[symbols_sent_]);
             const char symbol = symbol_map_.contains(upper_case_symbol) ? upper_case_symbol : ' ';
             std::cout << "--> '" << symbol << "'\n";
             event.set_symbol(event_id::transmit_symbol, symbol_map_.at(symbol));
@@ -11,7 +11,7 @@ namespace co_fsm::morse
 
     private:
         static const std::unordered_map<char, std::string_view> symbol_map_;
-        std::string message_ {};
+        co_fsm::pooled_buffer message_ {};
         std::uint32_t symbols_sent_ {};
     };
 }
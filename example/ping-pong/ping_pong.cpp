@@ -1,3 +1,4 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
 #include "simple_logger.hpp"
 
 #include <array>
@@ -138,6 +139,8 @@ namespace co_fsm::ping_pong
         // fsm.set_logger(simple_logger<FSM> {std::cerr});
         // fsm.logger_ = simple_logger<FSM> {std::cerr};
 
+        // Count the transitions taken (see the heat map at the end).
+        fsm.enable_transition_counters();
         fsm.start();
     }
 }
@@ -158,7 +161,10 @@ int main()
     using std::cout;
     cout << "\n1. Running...\n";
     event.set(event_id::to_ping, 3U);                       // Do the ping<->pong 3 times.
-    fsm.go_to(state_id::ping).send_event(std::move(event)); // Send to_ping to ping state.
+    {
+        const co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap}; // The transitions must not allocate.
+        fsm.go_to(state_id::ping).send_event(std::move(event)); // Send to_ping to ping state.
+    }
 
     // Now we should be back at Ping state.
     cout << fsm.id() << " suspended at state " << fsm.state_id() << '\n';
@@ -166,9 +172,16 @@ int main()
     // Do it again but this time start from Pong state.
     cout << "\n2. Running...\n";
     event.set(event_id::to_pong, 3U);                       // Do the ping<->pong 3 times.
-    fsm.go_to(state_id::pong).send_event(std::move(event)); // Send to_pong to pong state.
+    {
+        const co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap}; // The transitions must not allocate.
+        fsm.go_to(state_id::pong).send_event(std::move(event)); // Send to_pong to pong state.
+    }
 
     // Now we should be back at Pong state.
     cout << fsm.id() << " suspended at state " << fsm.state_id() << '\n';
+
+    // Print the number of times each transition has been taken.
+    cout << "\nTransition counts:\n";
+    co_fsm::write_transition_counts_csv(fsm, cout);
     return 0;
 }
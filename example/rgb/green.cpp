@@ -17,7 +17,7 @@ namespace co_fsm::rgb
                 std::this_thread::sleep_for(std::chrono::milliseconds {event.blink_time_in_ms()});
                 led_control_.set(led_control::Status::Off);
                 // Recycle the event from "StartBlink" to "BlinkReady".
-                event.set(event_id::blink_ready);
+                event.set_id(event_id::blink_ready);
             }
             else
             { // The event was not recognized.
@@ -45,7 +45,7 @@ namespace co_fsm::rgb
                 {
                     stopToken = std::move(event.stop_token());
                     blinks_left = number_of_blinks;                  // Do this many blinks before handing over to another FSM
-                    event.set(event_id::start_blink, blink_time_ms); // blink_time_ms piggybacks on "StartBlinkEvent"
+                    event.emplace<event_id::start_blink>(blink_time_ms); // blink_time_ms piggybacks on "StartBlinkEvent"
                     break;
                 }
                 case event_id::blink_ready: // A blink is ready.
@@ -55,11 +55,11 @@ namespace co_fsm::rgb
                         event.invalidate(); // Send an empty event. It will suspend the FSM.
                     else if (blinks_left && (--blinks_left) > 0)
                     { // Do more blinks?
-                        event.set(event_id::start_blink, blink_time_ms);
+                        event.emplace<event_id::start_blink>(blink_time_ms);
                     }
                     else
                     { // No more blinks, hand over to the next FSM by sending "HandOverEvent".
-                        event.set(event_id::hand_over, std::move(stopToken));
+                        event.emplace<event_id::hand_over>(std::move(stopToken));
                     }
 
                     break;
@@ -2,39 +2,20 @@
 #include "rgb.hpp"
 #include <co_fsm/headers.hpp>
 #include <stop_token>
-#include <variant>
 
 namespace co_fsm::rgb
 {
     using blink_time_ms_t = std::uint16_t;
 
-    class event: public co_fsm::event_base<event_id>
+    // The stop token travels on hand_over and the blink time on start_blink; blink_ready has no payload.
+    // The payloads are stored inline, so the event takes a cache line whatever the payload is.
+    class event: public co_fsm::inline_event<event_id, co_fsm::event_payload<event_id::hand_over, std::stop_token>,
+                                             co_fsm::event_payload<event_id::start_blink, blink_time_ms_t>>
     {
     public:
-        const std::stop_token& stop_token() const noexcept { return std::get<std::stop_token>(data); }
-        std::stop_token& stop_token() noexcept { return std::get<std::stop_token>(data); }
+        const std::stop_token& stop_token() const noexcept { return get<event_id::hand_over>(); }
+        std::stop_token& stop_token() noexcept { return get<event_id::hand_over>(); }
 
-        blink_time_ms_t blink_time_in_ms() const noexcept { return std::get<blink_time_ms_t>(data); }
-
-        void set(const event_id id) noexcept
-        {
-            set_id(id);
-            data = {};
-        }
-
-        void set(const event_id id, std::stop_token stop_token) noexcept
-        {
-            set_id(id);
-            data = std::move(stop_token);
-        }
-
-        void set(const event_id id, const blink_time_ms_t blink_time_ms) noexcept
-        {
-            set_id(id);
-            data = blink_time_ms;
-        }
-
-    private:
-        std::variant<std::monostate, std::stop_token, blink_time_ms_t> data {};
+        blink_time_ms_t blink_time_in_ms() const noexcept { return get<event_id::start_blink>(); }
     };
 }
@@ -1,8 +1,11 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
 #include "rgb.hpp"
 #include "common.hpp"
 #include "simple_logger.hpp"
 
 #include <array>
+#include <filesystem>
+#include <fstream>
 
 namespace co_fsm::rgb
 {
@@ -71,9 +74,10 @@ int main()
     blue_fsm << FSM::transition(state_id::idle, event_id::hand_over, state_id::idle, &red_fsm);
 
     // Activate the FSMs and set their respective intial states.
-    red_fsm.start().go_to(state_id::idle);
-    green_fsm.start().go_to(state_id::idle);
-    blue_fsm.start().go_to(state_id::idle);
+    // Live updates let apply() change the transition tables below while the FSMs may be running.
+    red_fsm.set_live_updates(true).start().go_to(state_id::idle);
+    green_fsm.set_live_updates(true).start().go_to(state_id::idle);
+    blue_fsm.set_live_updates(true).start().go_to(state_id::idle);
 
     // Activate tracing. Change to "#if 1" to use live tracing.
 #if 0
@@ -83,12 +87,30 @@ int main()
     blue_fsm.set_logger(logger);
 #endif
 
+    // Record the timelines of the FSMs. The records are flushed periodically by a background thread.
+    co_fsm::trace_recorder recorder {};
+    red_fsm.set_trace_recorder(&recorder);
+    green_fsm.set_trace_recorder(&recorder);
+    blue_fsm.set_trace_recorder(&recorder);
+    std::jthread flusher(
+        [&](std::stop_token stop_token)
+        {
+            while (!stop_token.stop_requested())
+            {
+                recorder.flush();
+                std::this_thread::sleep_for(100ms);
+            }
+        });
+
     // Start the action by sending a handover event to the given FSM.
     auto kick_off = [](std::stop_token stopToken, FSM* fsm)
     {
         Event e {};
         // The stop token of the thread piggy-backs to the fsm on the HandOver event.
-        e.set(event_id::hand_over, stopToken);
+        e.emplace<event_id::hand_over>(stopToken);
+        // The thread sends events to the FSM and to the other FSMs by handoffs.
+        fsm->prepare_thread();
+        const co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap}; // The transitions must not allocate.
         fsm->send_event(std::move(e));
     };
 
@@ -126,9 +148,13 @@ int main()
 
     // Re-configure transitions so that each FSM "hands over" to itself instead of another FSM,
     // making the FSMs independent.
-    red_fsm << FSM::transition(state_id::idle, event_id::hand_over, state_id::idle);
-    green_fsm << FSM::transition(state_id::idle, event_id::hand_over, state_id::idle);
-    blue_fsm << FSM::transition(state_id::idle, event_id::hand_over, state_id::idle);
+    // apply() publishes the changed transition table atomically, so it is safe even if the FSM is running on another thread.
+    for (FSM* fsm: {&red_fsm, &green_fsm, &blue_fsm})
+    {
+        FSM::transition_batch batch {};
+        batch << FSM::transition(state_id::idle, event_id::hand_over, state_id::idle);
+        fsm->apply(batch);
+    }
 
     // Show also the thread id in the trace.
     // redFSM->simple_logger = greenFSM->simple_logger = blueFSM->simple_logger = simple_logger {.printThreadId = true};
@@ -140,11 +166,23 @@ int main()
         std::jthread blue_thread(kick_off, &blue_fsm);
         std::this_thread::sleep_for(2s);
         printActive("All 3 are running in parallel:"); // All 3 should be active
+        for (std::jthread* thread: {&red_thread, &green_thread, &blue_thread})
+            thread->request_stop();
+        // Each FSM wakes this thread as soon as it suspends; there is no polling.
+        for (FSM* fsm: {&red_fsm, &green_fsm, &blue_fsm})
+            fsm->wait_idle();
     }
     printActive("All 3 have stopped:"); // All 3 should be inactive
 
     cout << "RED   fsm is suspended at state " << red_fsm.state_id() << '\n';
     cout << "GREEN fsm is suspended at state " << green_fsm.state_id() << '\n';
     cout << "BLUE  fsm is suspended at state " << blue_fsm.state_id() << '\n';
+
+    // Write the timelines. Open the file in chrome://tracing or https://ui.perfetto.dev.
+    flusher.request_stop();
+    const auto trace_path = std::filesystem::temp_directory_path() / "rgb_trace.json";
+    std::ofstream trace_file(trace_path);
+    recorder.write_chrome_trace(trace_file);
+    cout << "The timelines have been written to " << trace_path.string() << '\n';
     return 0;
 }
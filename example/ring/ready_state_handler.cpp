@@ -43,8 +43,7 @@ namespace co_fsm::ring
         else // The required number of rounds done.
         {
             end_time_ = clock::now();
-            const auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end_time_ - start_time_);
-            running_time_s += diff.count() / 1000.f;
+            running_time_s += std::chrono::duration<double>(end_time_ - start_time_).count();
             event.invalidate(); // Suspend the FSM by sending an empty event
         }
     }
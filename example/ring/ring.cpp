@@ -1,3 +1,4 @@
+#define CO_FSM_DEFINE_ALLOCATION_HOOKS
 #include "ring.hpp"
 #include "ready_state_handler.hpp"
 #include "ring_state_handler.hpp"
@@ -81,7 +82,10 @@ int main()
     // Make the first event which will start the show.
     Event event {};
     event.set(event_id::start, number_rounds_to_repeat); // Cycle around the ring numRoundsToRepeat times.
-    fsm.send_event(std::move(event));
+    {
+        const co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap}; // The transitions must not allocate.
+        fsm.send_event(std::move(event));
+    }
 
     using std::cout;
     cout << fsm.id() << "' is suspended at state '" << fsm.state_id() << "'\n";
@@ -90,5 +94,19 @@ int main()
          << " events sent,\n"
          << "the speed of FSM's execution is " << std::fixed << (events_processed + number_rounds_to_repeat) / running_time_s
          << " state transitions/s\n";
+
+    // Run the ring again with the latency histograms enabled and print the tail latency of the states.
+    fsm.enable_latency_histograms().enable_send_event_sampling(1U);
+    event.set(event_id::start, number_rounds_to_repeat);
+    fsm.send_event(std::move(event));
+
+    co_fsm::latency_histogram latency {};
+    for (const auto& item: fsm.get_latency_histograms())
+        latency.merge(item.histogram);
+    cout << "Latency of " << latency.count() << " transitions: p50 " << latency.p50() << " ns, p99 " << latency.p99() << " ns, p99.9 "
+         << latency.p999() << " ns\n";
+    const auto statistics = fsm.get_send_event_statistics();
+    cout << "Sampled send_event: ~" << statistics.transitions.p50() << " transitions in ~" << statistics.wall_time.p50()
+         << " ns (CPU time ~" << statistics.cpu_time.p50() << " ns)\n";
     return 0;
 }
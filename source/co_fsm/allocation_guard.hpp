@@ -0,0 +1,112 @@
+#pragma once
+#ifndef PCH
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <new>
+#endif
+
+// Verification that a running FSM does not allocate memory.
+// The global operator new and delete are replaced in the translation unit which defines CO_FSM_DEFINE_ALLOCATION_HOOKS
+// before including this header (exactly one translation unit of the program, typically the one with main).
+// A no_allocation_guard then counts or traps the allocations made by its thread while it is alive, e.g.
+//
+//   fsm.start();
+//   {
+//       co_fsm::no_allocation_guard guard {co_fsm::no_allocation_guard::mode::trap};
+//       fsm.send_event(std::move(event)); // It aborts if the transitions allocate.
+//   }
+//
+// Memory allocated directly by malloc is not seen; the library and the standard containers allocate through operator new.
+namespace co_fsm
+{
+    namespace detail
+    {
+        struct allocation_tracking
+        {
+            static inline thread_local std::uint64_t allocations {}; // Allocations made by the thread.
+            static inline thread_local unsigned trap_depth {};       // Number of active guards of the thread in trap mode.
+            static inline std::atomic_bool hooks_installed {};
+
+            static void on_allocation(const std::size_t size) noexcept
+            {
+                ++allocations;
+                if (trap_depth != 0U) [[unlikely]]
+                {
+                    trap_depth = 0U; // Reporting may allocate.
+                    std::fprintf(stderr, "co_fsm: allocation of %zu bytes while a no_allocation_guard is active.\n", size);
+                    std::abort();
+                }
+            }
+        };
+    }
+
+    // It counts (or traps) the allocations made by the calling thread during its lifetime.
+    class no_allocation_guard
+    {
+    public:
+        enum class mode
+        {
+            count, // The allocations are counted (see allocations).
+            trap,  // The first allocation aborts the program, so a debugger stops at the allocation.
+        };
+
+        explicit no_allocation_guard(const mode item = mode::count) noexcept:
+            start_(detail::allocation_tracking::allocations),
+            mode_(item)
+        {
+            if (mode_ == mode::trap)
+                ++detail::allocation_tracking::trap_depth;
+        }
+
+        no_allocation_guard(const no_allocation_guard&) = delete;
+        no_allocation_guard& operator= (const no_allocation_guard&) = delete;
+
+        ~no_allocation_guard()
+        {
+            if (mode_ == mode::trap && detail::allocation_tracking::trap_depth != 0U)
+                --detail::allocation_tracking::trap_depth;
+        }
+
+        // It returns the number of allocations made by the thread since the guard was created.
+        std::uint64_t allocations() const noexcept { return detail::allocation_tracking::allocations - start_; }
+
+        // It returns true if the allocations are tracked (i.e. CO_FSM_DEFINE_ALLOCATION_HOOKS is defined in the program).
+        static bool hooks_installed() noexcept { return detail::allocation_tracking::hooks_installed.load(std::memory_order_relaxed); }
+
+    private:
+        std::uint64_t start_;
+        mode mode_;
+    };
+}
+
+#ifdef CO_FSM_DEFINE_ALLOCATION_HOOKS
+namespace co_fsm::detail
+{
+    inline const bool allocation_hooks_installed = (allocation_tracking::hooks_installed.store(true), true);
+
+    inline void* allocate(const std::size_t size, const std::size_t alignment)
+    {
+        allocation_tracking::on_allocation(size);
+        const auto bytes = size != 0U ? size : 1U;
+        void* const memory = alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                                 ? std::malloc(bytes)
+                                 : std::aligned_alloc(alignment, (bytes + alignment - 1U) / alignment * alignment);
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        return memory;
+    }
+}
+
+void* operator new (const std::size_t size) { return co_fsm::detail::allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new (const std::size_t size, const std::align_val_t alignment)
+{
+    return co_fsm::detail::allocate(size, static_cast<std::size_t>(alignment));
+}
+void operator delete (void* const memory) noexcept { std::free(memory); }
+void operator delete (void* const memory, std::size_t) noexcept { std::free(memory); }
+void operator delete (void* const memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete (void* const memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef PCH
+    #include <atomic>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/membarrier.h>)
+    #include <linux/membarrier.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define CO_FSM_HAS_MEMBARRIER 1
+#else
+    #define CO_FSM_HAS_MEMBARRIER 0
+#endif
+
+// Asymmetric fences: a pair of a light fence executed often (e.g. each time an FSM suspends) and a heavy fence executed
+// rarely (e.g. when a thread starts waiting for the suspension). Together they order a store before a load on both sides
+// like two sequentially consistent fences. On Linux the light fence only stops the compiler and the heavy fence makes every
+// running thread of the process execute a full fence (membarrier); elsewhere both are full fences.
+namespace co_fsm::detail
+{
+    // It is true if the heavy fence is a membarrier, so the light fence can be a compiler barrier.
+    inline const bool asymmetric_fences = []
+    {
+#if CO_FSM_HAS_MEMBARRIER
+        return ::syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+        return false;
+#endif
+    }();
+
+    inline void light_fence() noexcept
+    {
+        if (asymmetric_fences) [[likely]]
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        else
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    inline void heavy_fence() noexcept
+    {
+#if CO_FSM_HAS_MEMBARRIER
+        if (asymmetric_fences && ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0)
+            return;
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
@@ -1,22 +1,47 @@
 #pragma once
 #ifndef PCH
+    #include <co_fsm/asymmetric_fence.hpp>
+    #include <co_fsm/borrowed_payload.hpp>
+    #include <co_fsm/epoch.hpp>
+    #include <co_fsm/latency.hpp>
+    #include <co_fsm/payload_pool.hpp>
+    #include <co_fsm/probes.hpp>
+    #include <co_fsm/spsc_queue.hpp>
+    #include <co_fsm/status.hpp>
+    #include <co_fsm/trace.hpp>
+    #include <co_fsm/transition_image.hpp>
+
+    #include <algorithm>
+    #include <array>
     #include <atomic>
+    #include <bit>
     #include <cassert>
+    #include <chrono>
+    #include <condition_variable>
+    #include <cstdint>
     #include <coroutine>
+    #include <exception>
     #include <functional>
+    #include <memory>
+    #include <mutex>
     #include <optional>
     #include <source_location>
     #include <sstream>
+    #include <stdexcept>
+    #include <unordered_map>
+    #include <vector>
 #endif
 
 namespace co_fsm
 {
-    // Default implementation of pair "state handle - event id" and of default (xor) hash of that pair.
-    template <typename _State_handle_type, typename _Event_id_type>
-    struct default_state_handle_event_id_pair: std::pair<_State_handle_type, _Event_id_type>
+    // Default implementation of pair "state index - event id" and of its hash.
+    // The state is identified by its index in the FSM (see automaton::state_index_type), since a lazily created state
+    // has no coroutine handle until it is entered for the first time.
+    template <typename _State_index_type, typename _Event_id_type>
+    struct default_state_handle_event_id_pair: std::pair<_State_index_type, _Event_id_type>
     {
-        using base = std::pair<_State_handle_type, _Event_id_type>;
-        using state_handle_type = _State_handle_type;
+        using base = std::pair<_State_index_type, _Event_id_type>;
+        using state_index_type = _State_index_type;
         using event_id_type = _Event_id_type;
 
         using base::base;
@@ -24,20 +49,68 @@ namespace co_fsm
         // Hash {state, event} - pair
         struct hash
         {
-            static auto handle_hash(const state_handle_type& handle) noexcept { return std::hash<void*>()(handle.address()); }
+            static auto index_hash(const state_index_type index) noexcept { return std::hash<state_index_type>()(index); }
             static auto event_id_hash(const event_id_type id) noexcept { return std::hash<event_id_type>()(id); }
 
             std::size_t operator() (const default_state_handle_event_id_pair& pair) const noexcept
             {
-                // Note: you could possibly do better than xor. See
-                // https://stackoverflow.com/questions/5889238/why-is-xor-the-default-way-to-combine-hashes
-                return handle_hash(pair.first) ^ event_id_hash(pair.second);
+                // The hashes are combined as boost::hash_combine does: a xor of an index and a small event id (which are
+                // their own hashes in common standard libraries) would map many pairs onto the same value.
+                auto seed = index_hash(pair.first);
+                seed ^= event_id_hash(pair.second) + std::size_t(0x9E3779B97F4A7C15ULL) + (seed << 6U) + (seed >> 2U);
+                return seed;
             }
         };
     };
 
+    namespace detail
+    {
+        // Work which the thread running the FSMs does when its outermost send_event or resume call returns, i.e. when no
+        // state of any FSM is running on the thread (e.g. resuming the coroutines which await automaton::until_idle).
+        struct deferred_task
+        {
+            deferred_task* next {};
+            void (*run)(void* owner) noexcept {};
+            void* owner {};
+        };
+
+        // Nesting depth of the send_event and resume calls of the thread and its deferred tasks.
+        class run_scope
+        {
+        public:
+            run_scope() noexcept { ++depth; }
+            run_scope(const run_scope&) = delete;
+            run_scope& operator= (const run_scope&) = delete;
+
+            ~run_scope()
+            {
+                if (--depth == 0U && tasks != nullptr) [[unlikely]]
+                    run_tasks();
+            }
+
+            static void defer(deferred_task& task) noexcept { task.next = std::exchange(tasks, &task); }
+
+        private:
+            static void run_tasks() noexcept
+            {
+                ++depth; // The tasks may send events; they run when those calls return.
+                while (auto* const task = tasks)
+                {
+                    tasks = task->next;
+                    task->run(task->owner);
+                }
+                --depth;
+            }
+
+            static inline thread_local unsigned depth {};
+            static inline thread_local deferred_task* tasks {};
+        };
+    }
+
     // Finite State Machine class.
-    // default_state_handle_event_id_pair parameter allows the customization of "state handle - event id" pair and their hashing.
+    // default_state_handle_event_id_pair parameter allows the customization of "state index - event id" pair and their hashing.
+    // The pair is instantiated with automaton::state_index_type as its first type (it was the state handle type before lazy
+    // states were added), so a custom pair must accept and hash a state index.
     template <typename _Event, typename _State, typename _Id = std::uint8_t,
               template <typename...> class _State_handle_event_id_pair = default_state_handle_event_id_pair>
     class automaton
@@ -49,6 +122,24 @@ namespace co_fsm
         using event_id_type = typename event_type::id_type;
         using state_id_type = typename state_type::id_type;
         using state_handle_type = typename state_type::handle_type;
+        using state_index_type = std::size_t;
+
+        // It is true if transition images can be attached (see attach_image), i.e. if the state and event ids are integral or
+        // enumeration ids. The image code is not instantiated for other ids (e.g. strings).
+        static inline constexpr bool supports_images = detail::is_integer_id<state_id_type> && detail::is_integer_id<event_id_type>;
+
+        // It creates the coroutine of a lazily created state (see add_lazy_state).
+        using state_factory = std::function<state_type(automaton& fsm, const state_id_type id)>;
+
+        // Eviction of idle lazy states (see set_eviction_policy).
+        struct eviction_policy
+        {
+            using hook = std::function<void(automaton& fsm, const state_id_type id)>;
+
+            std::size_t frame_budget {}; // Maximum number of bytes of resident coroutine frames. Zero disables the eviction.
+            hook on_evict {};            // It is called before the frame of a state is destroyed (e.g. to persist its data).
+            hook on_restore {};          // It is called after the frame of an evicted state has been re-created by its factory.
+        };
 
         struct transition
         {
@@ -70,49 +161,112 @@ namespace co_fsm
             }
         };
 
-        // Target state of a transition (i.e. go to the 'state' which belongs in 'fsm').
+        // Target state of a transition (i.e. go to the state at index 'state' which belongs in 'fsm').
+        // The index is bound to the coroutine handle when the transition is made.
+        // The hit counter and the latency histogram of the transition are kept apart (see edge_statistics), so the entries
+        // of the transition map stay small and immutable.
         struct transition_target
         {
-            state_handle_type state {};
+            std::uint32_t state {};
+            std::uint32_t edge {}; // Index of the statistics of the transition in the FSM which owns the entry (or no_edge).
             automaton* fsm {};
         };
 
+        // Transition and the number of times it has been made.
+        struct transition_count
+        {
+            transition item;
+            std::uint64_t count;
+
+            using vector = std::vector<transition_count>;
+        };
+
+        // Transition and the latencies of its source state.
+        struct transition_latency
+        {
+            transition item;
+            latency_histogram histogram;
+
+            using vector = std::vector<transition_latency>;
+        };
+
+        // Statistics of the sampled send_event calls (see enable_send_event_sampling).
+        // An injection is a send_event call; it lasts until the FSM suspends on an invalid event.
+        struct send_event_statistics
+        {
+            std::uint64_t injections {};   // Number of send_event calls while the sampling was enabled.
+            std::uint64_t sampled {};      // Number of measured send_event calls.
+            latency_histogram wall_time {}; // Wall time of the measured calls in nanoseconds.
+            latency_histogram cpu_time {};  // CPU time of the calling thread during the measured calls in nanoseconds.
+            latency_histogram transitions {}; // Number of transitions of this FSM during the measured calls.
+        };
+
         struct awaitable
         {
             automaton* self {};
             constexpr bool await_ready() const noexcept { return false; }
 
-            state_handle_type make_transition(const state_handle_type& from_state, const event_id_type on_event_id,
-                                              transition_target to) const
+            std::coroutine_handle<> make_transition(const state_handle_type& from_state, const event_id_type on_event_id,
+                                                    const transition_target to) const
             {
+                // The target FSM runs on the thread of its stage, so the event is queued into its channel (see set_channel).
+                if (to.fsm != self && to.fsm->channel_ != nullptr) [[unlikely]]
+                    return self->forward(from_state, on_event_id, to);
+
+                // The target state is created and started here if it has been registered lazily and it is entered for the first time.
+                const state_handle_type to_state = to.fsm->resolve(to.state);
+
                 // The event is typically being sent to a state owned by this FSM (i.e. self).
                 // However, it may also be going to a state owned by another FSM.
-                // The destination FSM is in TransitionTarget struct together with the state handle.
+                // The destination FSM is in TransitionTarget struct together with the state index.
                 if (to.fsm == self)
                 { // The target state lives in this FSM.
-                    self->state_ = to.state;
+                    self->state_ = to_state;
+                    CO_FSM_PROBE(transition, detail::to_trace_integer(self->id_), detail::to_trace_integer(from_state.promise().id),
+                                 detail::to_trace_integer(on_event_id), detail::to_trace_integer(to_state.promise().id));
+                    if (self->tracer_) [[unlikely]]
+                        self->trace_transition(from_state, on_event_id, *self, to_state);
 
                     if (self->logger_)
-                        self->logger_(self->id_, self->id_, from_state.promise().id, on_event_id, to.state.promise().id);
+                        self->logger_(self->id_, self->id_, from_state.promise().id, on_event_id, to_state.promise().id);
+
+                    if (self->publish_status_) [[unlikely]]
+                        self->publish_transition(on_event_id);
 
-                    self->is_active_.store(true, std::memory_order_relaxed);
-                    return to.state;
+                    // Without a budget it costs a compare (see set_transition_budget).
+                    if (self->budget_left_ != 0U && --self->budget_left_ == 0U) [[unlikely]]
+                        return self->pause();
+
+                    return to_state;
                 }
 
                 // The target state lives in another FSM.
                 // Note: self FSM will suspend and self->state remains in the state where it left off when to.fsm took over.
-                to.fsm->state_ = to.state; // to.fsm will resume.
+                to.fsm->state_ = to_state; // to.fsm will resume.
+                CO_FSM_PROBE(handoff, detail::to_trace_integer(self->id_), detail::to_trace_integer(to.fsm->id_),
+                             detail::to_trace_integer(from_state.promise().id), detail::to_trace_integer(on_event_id),
+                             detail::to_trace_integer(to_state.promise().id));
+                if (self->tracer_) [[unlikely]]
+                    self->trace_transition(from_state, on_event_id, *to.fsm, to_state);
+                if (to.fsm->measure_latency_) [[unlikely]]
+                    to.fsm->entered_at_ = latency_clock::now();
                 // Move the event to the target FSM. The event of the target FSM should be invalid.
                 assert(to.fsm->event_.is_valid() == false);
                 to.fsm->event_ = std::move(self->event_);
+                to.fsm->budget_left_ = to.fsm->budget_;
 
                 if (self->logger_)
-                    self->logger_(self->id_, to.fsm->id_, from_state.promise().id, to.fsm->event_.id(), to.state.promise().id);
+                    self->logger_(self->id_, to.fsm->id_, from_state.promise().id, to.fsm->event_.id(), to_state.promise().id);
+
+                if (to.fsm->publish_status_) [[unlikely]]
+                    to.fsm->publish_status(on_event_id, true);
+                if (self->publish_status_) [[unlikely]]
+                    self->publish_status(on_event_id, false);
 
                 // Self is suspended and to.fsm is resumed.
-                self->is_active_.store(false, std::memory_order_relaxed);
                 to.fsm->is_active_.store(true, std::memory_order_relaxed);
-                return to.state;
+                self->set_idle();
+                return to_state;
             }
 
             std::coroutine_handle<> await_suspend(state_handle_type from_state) const
@@ -124,19 +278,52 @@ namespace co_fsm
                 {
                     const auto on_event_id = on_event.id();
                     // Find the destination for {from_state, on_event}-pair.
-                    if (auto it = self->transitions_.find({from_state, on_event_id}); it != self->transitions_.end())
+                    // The attached transition image (if any) is a dense table, so it is looked up first.
+                    if constexpr (supports_images)
                     {
+                        if (self->image_)
+                        {
+                            const auto slot = self->image_.slot(from_state.promise().index, detail::to_integer(on_event_id));
+                            if (const auto to_index = self->image_.target_at(slot); to_index != transition_image::npos)
+                            {
+                                count(self->transitions_made_);
+                                if (self->count_transitions_) [[unlikely]]
+                                    count(self->image_hits_[slot]);
+                                if (self->measure_latency_) [[unlikely]]
+                                    self->record_latency(self->image_latency_[slot]);
+                                return make_transition(from_state, on_event_id, {to_index, no_edge, self});
+                            }
+                        }
+                    }
+
+                    // The table is immutable once published, so a single acquire-load gives a consistent version.
+                    // The guard is nested in the guard of send_event unless another FSM has handed off to this one.
+                    const epoch_guard guard {self->live_updates_};
+                    const auto& transitions = self->transitions_.load(std::memory_order_acquire)->map;
+                    if (auto it = transitions.find({from_state.promise().index, on_event_id}); it != transitions.end())
+                    {
+                        count(self->transitions_made_);
+                        if (self->count_transitions_) [[unlikely]]
+                            count(self->edge_at(it->second.edge).hits);
+                        if (self->measure_latency_) [[unlikely]]
+                            self->record_latency(self->edge_at(it->second.edge).latency);
                         return make_transition(from_state, on_event_id, it->second);
                     }
 
+                    self->fire_error_probe(probe_error::missing_transition, from_state.promise().id, on_event_id);
+                    self->missing_transitions_.store(self->missing_transitions_.load(std::memory_order_relaxed) + 1U,
+                                                     std::memory_order_relaxed);
+                    if (self->missing_transition_policy_ == missing_transition_policy::suspend)
+                        return self->suspend(from_state);
+
+                    self->stop_on_error();
                     auto error_message = self->create_error_message();
                     error_message << "' can't find transition from state '" << from_state.promise().id << "' on event '" << on_event_id
                                   << "'.\nPlease fix the transition table.";
                     throw std::runtime_error(error_message.str());
                 }
 
-                self->is_active_.store(false, std::memory_order_relaxed);
-                return std::noop_coroutine();
+                return self->suspend(from_state);
             }
 
             event_type await_resume()
@@ -144,6 +331,8 @@ namespace co_fsm
                 if (self->event_.is_valid())
                     return std::move(self->event_);
 
+                self->fire_error_probe(probe_error::empty_event, self->state_id(), event_id_type {});
+                self->stop_on_error();
                 auto error_message = self->create_error_message();
                 error_message << "An empty event has been sent to state " << self->state_id();
                 throw std::runtime_error(error_message.str());
@@ -161,12 +350,21 @@ namespace co_fsm
                 if (self->event_.is_valid())
                     return std::move(self->event_);
 
+                self->fire_error_probe(probe_error::empty_event, self->state_id(), event_id_type {});
+                self->stop_on_error();
                 auto error_message = self->create_error_message();
                 error_message << "An empty event has been sent to state " << self->state_id();
                 throw std::runtime_error(error_message.str());
             }
         };
 
+        // What the FSM does when a state emits an event which has no transition (see set_missing_transition_policy).
+        enum class missing_transition_policy : std::uint8_t
+        {
+            throw_error, // The send_event or resume call throws; the state which has emitted the event can't run any more.
+            suspend,     // The FSM suspends in the state which has emitted the event, as on an invalid event.
+        };
+
         using logger_functor = std::function<void(const id_type fsm, const id_type target_fsm, const state_id_type from_state,
                                                   const event_id_type on_event_id, const state_id_type to_state)>;
 
@@ -177,7 +375,16 @@ namespace co_fsm
         automaton(automaton&&) noexcept = default;
         automaton& operator= (const automaton&) = delete;
         automaton& operator= (automaton&&) noexcept = default;
-        ~automaton() = default;
+        ~automaton()
+        {
+            if (status_slot_ != nullptr)
+                status_slot_->release();
+            for (const auto& [fsm, count]: targets_)
+                fsm->remove_referrer(this);
+            for (auto* const referrer: copy_referrers())
+                referrer->forget_target(this);
+            delete transitions_.load(std::memory_order_relaxed);
+        }
 
         id_type id() const noexcept { return id_; }
 
@@ -185,10 +392,117 @@ namespace co_fsm
         // are suspended and waiting for an event.
         bool is_active() const noexcept { return is_active_; }
 
+        using status_type = automaton_status<state_id_type, event_id_type>;
+
+        // It enables or disables the status which other threads read by status() while the FSM runs, e.g. a monitoring
+        // thread which reports the state of every FSM. When enabled, every transition writes the current state, the
+        // latest event and the number of transitions into a seqlock (two stores of its sequence and the stores of the
+        // fields). The active flag and the timestamp are written when the FSM starts running (send_event, resume or a
+        // transition into it) and when it stops, so latency_clock is not read per transition; a monitor recognizes an FSM
+        // which is stuck in a state by a number of transitions which doesn't change. The readers never block the FSM.
+        // It must be called by the thread which runs the FSM or while the FSM is suspended.
+        automaton& enable_status(const bool enable = true)
+        {
+            if (enable)
+            {
+                latency_clock::calibrate();
+                if (event_.is_valid())
+                    status_draft_.event = detail::to_status_id(event_.id());
+                publish_status(is_active_.load(std::memory_order_relaxed));
+            }
+
+            status_enabled_ = enable;
+            publish_status_ = status_enabled_ || status_slot_ != nullptr;
+            return *this;
+        }
+
+        bool status_enabled() const noexcept { return status_enabled_; }
+
+        // It exports the status of the FSM into a shared memory slot (see status_registry::attach), so another process can
+        // read it, or stops the export and gives the slot back if the slot is null. The slot is updated like the status of
+        // enable_status, with relaxed stores, and counts the errors. The slot is given back when the FSM is destroyed.
+        // It must be called by the thread which runs the FSM or while the FSM is suspended.
+        automaton& set_status_slot(status_slot* const slot) noexcept
+        {
+            if (status_slot_ != nullptr)
+                status_slot_->release();
+
+            status_slot_ = slot;
+            if (slot != nullptr)
+            {
+                if (event_.is_valid())
+                    status_draft_.event = detail::to_status_id(event_.id());
+                publish_status(is_active_.load(std::memory_order_relaxed));
+            }
+
+            publish_status_ = status_enabled_ || status_slot_ != nullptr;
+            return *this;
+        }
+
+        status_slot* get_status_slot() const noexcept { return status_slot_; }
+
+        // It returns a consistent snapshot of the status (see enable_status). It can be called by any thread and doesn't
+        // block the FSM; it retries while the FSM updates the status. The status keeps its latest value when disabled.
+        status_type status() const noexcept { return status_.load(); }
+
+        // It blocks the calling thread until the FSM is suspended or paused, without polling (see std::atomic::wait).
+        // It must not be called by the thread which runs the FSM. The FSM wakes the waiters when it suspends; without
+        // waiters the suspension costs a check of their number.
+        void wait_idle() noexcept
+        {
+            if (!is_active_.load(std::memory_order_acquire))
+                return;
+
+            add_waiter();
+            while (is_active_.load(std::memory_order_acquire))
+                is_active_.wait(true, std::memory_order_acquire);
+            waiters_.fetch_sub(1U, std::memory_order_release);
+        }
+
+        // It blocks the calling thread until the FSM is suspended or paused or the timeout elapses.
+        // It returns true if the FSM is suspended or paused.
+        template <typename _Rep, typename _Period>
+        bool wait_idle_for(const std::chrono::duration<_Rep, _Period>& timeout)
+        {
+            if (!is_active_.load(std::memory_order_acquire))
+                return true;
+
+            // std::atomic::wait has no timeout, so the timed waiters wait on a condition variable.
+            add_waiter();
+            std::unique_lock lock {waiter_mutex_};
+            const bool idle = waiter_condition_.wait_for(lock, timeout, [this] { return !is_active_.load(std::memory_order_acquire); });
+            lock.unlock();
+            waiters_.fetch_sub(1U, std::memory_order_release);
+            return idle;
+        }
+
+        // Awaitable which resumes the awaiting coroutine when the FSM is suspended or paused (see until_idle).
+        struct idle_awaitable
+        {
+            automaton* fsm {};
+            std::coroutine_handle<> continuation {};
+            idle_awaitable* next {};
+
+            bool await_ready() const noexcept { return !fsm->is_active(); }
+            bool await_suspend(const std::coroutine_handle<> handle)
+            {
+                continuation = handle;
+                return fsm->add_idle_awaiter(*this);
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        // It returns an awaitable for 'co_await fsm.until_idle()'. The awaiting coroutine is resumed by the thread which
+        // runs the FSM when its outermost send_event or resume call returns, so no thread blocks.
+        idle_awaitable until_idle() noexcept { return {this}; }
+
         // The event that was sent in the latest transition.
+        // It must be called by the thread which runs the FSM; other threads read status().
         const event_type& latest_event() const noexcept { return event_; }
 
         // It returns the name of the target state of the latest transition.
+        // It must be called by the thread which runs the FSM; other threads read status().
         state_id_type state_id() const { return state_ ? state_.promise().id : state_id_type {}; }
 
         std::ostringstream create_error_message() const
@@ -205,12 +519,16 @@ namespace co_fsm
             return *this;
         }
 
+        // A lazily created state is created and started if needed.
         automaton& go_to(const state_id_type id)
         {
-            state_ = find_handle(id);
-            if (state_)
+            if (const auto index = find_index(id); index != npos)
+            {
+                state_ = resolve(index);
                 return *this;
+            }
 
+            fire_error_probe(probe_error::invalid_state, id, event_id_type {});
             auto error_message = create_error_message();
             error_message << std::source_location::current().function_name() << " did not find the requested state '" << id << '\'';
             throw std::runtime_error(error_message.str());
@@ -222,10 +540,11 @@ namespace co_fsm
         // It returns true if {from, on_event} pair has not been routed previously.
         // It returns false if an existing destination is replaced with '{to, target_fsm}'.
         // It should return typically true unless the state machine is deliberately modified on the fly.
+        // The table is changed in place; use apply() to change it while the FSM may be running on another thread (see set_live_updates).
         bool add_transition(const state_handle_type& from, const event_id_type on_event, const state_handle_type& to, automaton* target_fsm)
         {
             assert(target_fsm != nullptr);
-            return transitions_.insert_or_assign({from, on_event}, transition_target {to, target_fsm}).second;
+            return add_transition_at(from.promise().index, on_event, to.promise().index, target_fsm);
         }
 
         bool add_transition(const state_handle_type& from, const event_id_type on_event, const state_handle_type& to)
@@ -238,8 +557,8 @@ namespace co_fsm
                             automaton* target_fsm)
         {
             assert(target_fsm != nullptr);
-            const state_handle_type from_handle = this->find_handle(from_state);
-            if (!from_handle)
+            const auto from_index = this->find_index(from_state);
+            if (from_index == npos)
             {
                 auto error_message = create_error_message();
                 error_message << std::source_location::current().function_name() << " did not find the requested source state '"
@@ -247,8 +566,8 @@ namespace co_fsm
                 throw std::runtime_error(error_message.str());
             }
 
-            const state_handle_type to_handle = target_fsm->find_handle(to_state);
-            if (!to_handle)
+            const auto to_index = target_fsm->find_index(to_state);
+            if (to_index == npos)
             {
                 auto error_message = create_error_message();
                 error_message << std::source_location::current().function_name() << " did not find the requested target state '" << to_state
@@ -256,7 +575,7 @@ namespace co_fsm
                 throw std::runtime_error(error_message.str());
             }
 
-            return add_transition(from_handle, on_event, to_handle, target_fsm);
+            return add_transition_at(from_index, on_event, to_index, target_fsm);
         }
 
         bool add_transition(const state_id_type from_state, const event_id_type on_event, const state_id_type to_state)
@@ -268,8 +587,8 @@ namespace co_fsm
                             automaton* const target_fsm)
         {
             assert(target_fsm != nullptr);
-            const state_handle_type to_handle = target_fsm->find_handle(to_state);
-            if (!to_handle)
+            const auto to_index = target_fsm->find_index(to_state);
+            if (to_index == npos)
             {
                 auto error_message = create_error_message();
                 error_message << std::source_location::current().function_name() << " did not find the requested target state'" << to_state
@@ -277,7 +596,7 @@ namespace co_fsm
                 throw std::runtime_error(error_message.str());
             }
 
-            return add_transition(from_handle, on_event, to_handle, target_fsm);
+            return add_transition_at(from_handle.promise().index, on_event, to_index, target_fsm);
         }
 
         bool add_transition(const state_handle_type& from_handle, const event_id_type on_event, const state_id_type to_state)
@@ -289,8 +608,8 @@ namespace co_fsm
                             automaton* const target_fsm)
         {
             assert(target_fsm != nullptr);
-            const state_handle_type from_handle = this->find_handle(from_state);
-            if (!from_handle)
+            const auto from_index = this->find_index(from_state);
+            if (from_index == npos)
             {
                 auto error_message = create_error_message();
                 error_message << std::source_location::current().function_name() << " did not find the requested source state'"
@@ -298,7 +617,7 @@ namespace co_fsm
                 throw std::runtime_error(error_message.str());
             }
 
-            return add_transition(from_handle, on_event, to_handle, target_fsm);
+            return add_transition_at(from_index, on_event, to_handle.promise().index, target_fsm);
         }
 
         bool add_transition(const state_id_type from_state, const event_id_type on_event, const state_handle_type& to_handle)
@@ -318,14 +637,12 @@ namespace co_fsm
         // It returns true if the transition was found and successfully removed.
         bool remove_transition(const state_handle_type& from_state, const event_id_type on_event)
         {
-            const auto erased = transitions_.erase({from_state, on_event});
-            return erased != 0U;
+            return remove_transition_at(from_state.promise().index, on_event);
         }
 
         bool remove_transition(const state_id_type from_state, const event_id_type on_event)
         {
-            const auto erased = transitions_.erase({find_handle(from_state), on_event});
-            return erased != 0U;
+            return remove_transition_at(find_index(from_state), on_event);
         }
 
         // A shortcut for writing "fsm >> transition(from, event)" instead of "fsm.removeTransition(from, event)".
@@ -338,32 +655,126 @@ namespace co_fsm
         // It returns true if the FSM knows how to deal with event 'on_event' sent from state 'from_state'.
         bool has_transition(const state_handle_type& from_state, const event_id_type on_event) const
         {
-            return transitions_.contains({from_state, on_event});
+            return from_state && find_target(from_state.promise().index, on_event).has_value();
         }
 
         bool has_transition(const state_id_type from_state, const event_id_type on_event) const
         {
-            return transitions_.contains({find_handle(from_state), on_event});
+            const auto from_index = find_index(from_state);
+            return from_index != npos && find_target(from_index, on_event).has_value();
         }
 
+        // It sets what the FSM does when a state emits an event which has no transition. By default it throws, so a
+        // missing transition is found early; the suspend policy suits FSMs which receive events that only some of their
+        // states handle (e.g. a notice multicast to every session). Either way the missing transitions are counted.
+        // It is a setting of the FSM, chosen when the FSM is set up; it must not be changed while the FSM runs.
+        automaton& set_missing_transition_policy(const missing_transition_policy policy) noexcept
+        {
+            missing_transition_policy_ = policy;
+            return *this;
+        }
+
+        missing_transition_policy get_missing_transition_policy() const noexcept { return missing_transition_policy_; }
+
+        // It returns the number of events emitted by the states which have had no transition.
+        // It can be called while the FSM is running on another thread.
+        std::uint64_t missing_transitions() const noexcept { return missing_transitions_.load(std::memory_order_relaxed); }
+
         // It returns a vector of transitions.
+        // The transitions of the attached transition image come first, followed by the transitions
+        // which are not covered by the image.
         transition::vector get_transitions() const
         {
             typename transition::vector result {};
-            result.reserve(transitions_.size());
-            for (const auto& [from_state_on_event, to_state]: transitions_)
-                result.emplace_back(from_state_on_event.first.promise().id, from_state_on_event.second, to_state.state.promise().id,
-                                    to_state.fsm);
+            for_each_transition([&](const transition& item, std::uint64_t&, latency_histogram*&) { result.push_back(item); });
+            return result;
+        }
+
+        // It enables or disables the per-transition hit counters.
+        // The counters are indexed by the transition entries, so counting costs a single increment per transition.
+        // The counts survive apply(): a {state, event} pair which is re-routed keeps its counter.
+        automaton& enable_transition_counters(const bool enable = true)
+        {
+            if (enable && image_ && !image_hits_)
+                image_hits_ = std::make_unique<std::uint64_t[]>(image_.size());
+            count_transitions_ = enable;
+            return *this;
+        }
+
+        bool transition_counters_enabled() const noexcept { return count_transitions_; }
+
+        // It returns a snapshot of the transitions (in the order of get_transitions) and their hit counts.
+        // It can be called while the FSM is running on another thread.
+        transition_count::vector get_transition_counts() const
+        {
+            typename transition_count::vector result {};
+            for_each_transition([&](const transition& item, std::uint64_t& hits, latency_histogram*&)
+                                { result.push_back({item, std::atomic_ref<std::uint64_t>(hits).load(std::memory_order_relaxed)}); });
+            return result;
+        }
+
+        // It resets the hit counters.
+        automaton& reset_transition_counters()
+        {
+            for_each_transition([](const transition&, std::uint64_t& hits, latency_histogram*&)
+                                { std::atomic_ref<std::uint64_t>(hits).store(0U, std::memory_order_relaxed); });
+            return *this;
+        }
+
+        // It enables or disables the latency histograms. When enabled, the time from entering a state until the state
+        // emits an event (i.e. the time spent in the handler of the source state plus the dispatch of the transition) is
+        // recorded into the histogram of the {state, event} edge taken. The histogram of an edge (8 KiB) is allocated when
+        // the edge is taken for the first time. Each transition reads latency_clock once.
+        automaton& enable_latency_histograms(const bool enable = true)
+        {
+            if (enable)
+            {
+                latency_clock::calibrate();
+                if (image_ && !image_latency_)
+                    image_latency_ = std::make_unique<latency_histogram*[]>(image_.size());
+                entered_at_ = latency_clock::now();
+            }
+
+            measure_latency_ = enable;
+            return *this;
+        }
+
+        bool latency_histograms_enabled() const noexcept { return measure_latency_; }
+
+        // It returns a snapshot of the latency histograms of the edges which have been taken (in the order of get_transitions).
+        // It can be called while the FSM is running on another thread. The histograms of several FSMs or threads can be
+        // combined with latency_histogram::merge.
+        transition_latency::vector get_latency_histograms() const
+        {
+            typename transition_latency::vector result {};
+            for_each_transition(
+                [&](const transition& item, std::uint64_t&, latency_histogram*& latency)
+                {
+                    if (const auto* const histogram = std::atomic_ref<latency_histogram*>(latency).load(std::memory_order_acquire))
+                        result.push_back({item, *histogram});
+                });
             return result;
         }
 
+        // It clears the latency histograms.
+        automaton& reset_latency_histograms()
+        {
+            for_each_transition(
+                [](const transition&, std::uint64_t&, latency_histogram*& latency)
+                {
+                    if (auto* const histogram = std::atomic_ref<latency_histogram*>(latency).load(std::memory_order_acquire))
+                        histogram->reset();
+                });
+            return *this;
+        }
+
         // It finds the target state of 'on_event' event id when it sent from state handle 'from_state'.
         // It returns an empty state id if the state is not found.
         std::optional<state_id_type> target_state(const state_handle_type& from_state, const event_id_type on_event) const noexcept
         {
-            const auto it = transitions_.find({from_state, on_event});
-            if (it != transitions_.end())
-                return it->second.state.promise().id;
+            if (from_state)
+                if (const auto target = find_target(from_state.promise().index, on_event))
+                    return target->fsm->states_[target->state].id;
             return {};
         }
 
@@ -371,7 +782,10 @@ namespace co_fsm
         // It returns an empty state id if the state is not found.
         std::optional<state_id_type> target_state(const state_id_type from_state, const event_id_type on_event) const
         {
-            return target_state(find_handle(from_state), on_event);
+            if (const auto from_index = find_index(from_state); from_index != npos)
+                if (const auto target = find_target(from_index, on_event))
+                    return target->fsm->states_[target->state].id;
+            return {};
         }
 
         // It emits the given event and returns an awaitable which gives
@@ -389,17 +803,16 @@ namespace co_fsm
         // It returns the index of the vector to which the state was stored.
         std::size_t add_state(state_type&& state)
         {
-            if (has_state(state.id()))
-            {
-                std::ostringstream error_message {};
-                error_message << "A state with id '" << state.id() << "' already exists in FSM " << id_;
-                throw std::runtime_error(error_message.str());
-            }
-
             if (state.handle())
             {
-                states_.push_back(std::move(state));
-                return states_.size() - 1U;
+                const auto id = state.id();
+                const auto index = add_slot(id, no_factory);
+                state.handle().promise().index = index;
+                states_[index].frame_size = static_cast<std::uint32_t>(state.frame_size());
+                resident_frame_bytes_ += state.frame_size();
+                states_[index].state = std::move(state);
+                ++materialized_count_;
+                return index;
             }
 
             std::ostringstream error_message {};
@@ -414,103 +827,1487 @@ namespace co_fsm
             return *this;
         }
 
-        // It returns reference to the state object at the given index.
-        const state_type& state_at(const std::size_t index) const { return states_.at(index); }
+        // Set of changes of the transition table which are applied at once (see apply).
+        class transition_batch
+        {
+        public:
+            // It adds (or replaces) the transition.
+            transition_batch& operator<< (const transition& item)
+            {
+                changes_.push_back({item, false});
+                return *this;
+            }
 
-        // It returns the number of states in the FSM.
-        std::size_t state_count() const noexcept { return states_.size(); }
+            // It removes the transition triggered by item.event sent from item.from.
+            transition_batch& operator>> (const transition& item)
+            {
+                changes_.push_back({item, true});
+                return *this;
+            }
 
-        // It gets the states going from the initial suspension.
-        automaton& start()
+            bool empty() const noexcept { return changes_.empty(); }
+            std::size_t size() const noexcept { return changes_.size(); }
+
+        private:
+            friend class automaton;
+
+            struct change
+            {
+                transition item;
+                bool remove;
+            };
+
+            std::vector<change> changes_ {};
+        };
+
+        // It applies the batch of changes to a copy of the transition table and publishes the copy atomically.
+        // If live updates are enabled (see set_live_updates), it is safe to call while the FSM runs on another thread: a
+        // transition sees either the previous or the new version, never a partially updated table. The previous version is
+        // reclaimed when no running FSM can see it.
+        // If a state of the batch is not found, an exception is thrown and the table is not changed.
+        // It returns the version of the published table.
+        std::uint64_t apply(const transition_batch& batch)
+        {
+            std::lock_guard lock {update_mutex_};
+            // Every change is validated first, so a bad change doesn't leave side effects of the changes before it.
+            for (const auto& [item, remove]: batch.changes_)
+            {
+                const auto from_index = find_index(item.from);
+                const auto to_index = remove ? std::size_t {} : (item.target == nullptr ? this : item.target)->find_index(item.to);
+                if (from_index == npos || to_index == npos)
+                {
+                    auto error_message = create_error_message();
+                    error_message << std::source_location::current().function_name() << " did not find the state '"
+                                  << (from_index == npos ? item.from : item.to) << "'.";
+                    throw std::runtime_error(error_message.str());
+                }
+            }
+
+            const auto* const current = transitions_.load(std::memory_order_relaxed);
+            auto next = std::make_unique<transition_table>(*current);
+            auto targets = targets_;
+            for (const auto& [item, remove]: batch.changes_)
+            {
+                const state_handle_event_id_pair key {find_index(item.from), item.event};
+                const auto it = next->map.find(key);
+                const auto previous_fsm = it != next->map.end() ? it->second.fsm : nullptr;
+                if (remove)
+                {
+                    if (it != next->map.end())
+                        next->map.erase(it);
+                    retarget(targets, previous_fsm, nullptr);
+                    continue;
+                }
+
+                const auto target_fsm = item.target == nullptr ? this : item.target;
+                const auto to_index = target_fsm->find_index(item.to);
+                const auto edge = it != next->map.end() ? it->second.edge : new_edge();
+                next->map.insert_or_assign(key, transition_target {std::uint32_t(to_index), edge, target_fsm});
+                retarget(targets, previous_fsm, target_fsm);
+            }
+
+            for (const auto& [fsm, count]: targets)
+                if (count != 0U)
+                    fsm->add_referrer(this);
+
+            ++next->version;
+            const auto version = next->version;
+            transitions_.store(next.release(), std::memory_order_release);
+            epoch_domain::instance().retire(current);
+            targets_ = std::move(targets);
+            release_targets();
+            return version;
+        }
+
+        // It makes send_event and resume protect the transition tables they read from reclamation, so apply() can be called
+        // while the FSM runs on another thread. It costs a sequentially consistent fence per send_event or resume call (and
+        // per transition into this FSM from an FSM without live updates), so it is disabled by default.
+        // It must be enabled before the FSM runs concurrently with apply() and must not be changed while the FSM is running.
+        automaton& set_live_updates(const bool enable) noexcept
         {
-            for (auto& state: states_)
-                if (!state.is_started()) // Resume only if the coroutine is still suspended in initial_suspend.
-                    state.handle().resume();
+            live_updates_ = enable;
             return *this;
         }
 
-        // It kicks off the state machine by sending the event.
-        // It sends to the state which is either the state where the FSM left off when it was
-        // suspended last time or the state which has been explicitly set by calling set_state().
-        automaton& send_event(event_type&& event)
+        bool live_updates() const noexcept { return live_updates_; }
+
+        // It returns the version of the transition table. It is incremented by every apply().
+        std::uint64_t transitions_version() const noexcept { return transitions_.load(std::memory_order_acquire)->version; }
+
+        // It attaches a transition image (see transition_image.hpp). The image is typically mapped from a file by mapped_file,
+        // which must outlive the FSM or the attachment. The states of the FSM must be registered in the same order and with
+        // the same ids as the states of the FSM which wrote the image; state indices are bound to coroutine handles only
+        // when a transition is made, so no per-transition work is done while attaching.
+        // The image takes precedence over the transitions added by add_transition for the {state, event} pairs it covers.
+        automaton& attach_image(const transition_image& image)
         {
-            if (state_.promise().is_started)
+            static_assert(supports_images, "Transition images need integral or enumeration state and event ids.");
+            if (image.state_count() != states_.size())
             {
-                event_ = std::move(event);
-                state_.resume();
-                return *this;
+                auto error_message = create_error_message();
+                error_message << "the transition image has " << image.state_count() << " states but the FSM has " << states_.size()
+                              << '.';
+                throw std::runtime_error(error_message.str());
             }
 
-            auto error_message = create_error_message();
-            error_message << std::source_location::current().function_name() << '(' << event.id() << ") can not resume state "
-                          << state_.promise().id << " because it has not been started. Call first fsm.start() to activate all states.";
-            throw std::runtime_error(error_message.str());
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+            {
+                if (image.state_id_at(i) != detail::to_integer(states_[i].id))
+                {
+                    auto error_message = create_error_message();
+                    error_message << "state '" << states_[i].id << "' at index " << i << " does not match the transition image.";
+                    throw std::runtime_error(error_message.str());
+                }
+            }
+
+            image_hits_ = count_transitions_ ? std::make_unique<std::uint64_t[]>(image.size()) : nullptr;
+            image_latency_ = measure_latency_ ? std::make_unique<latency_histogram*[]>(image.size()) : nullptr;
+            image_ = image;
+            return *this;
         }
 
-        // It finds the state based on state id.
-        // It returns null if the id is not found.
-        const state_type* find_state(const state_id_type state_id) const noexcept
+        // It detaches the transition image. Only the transitions added by add_transition remain.
+        automaton& detach_image() noexcept
         {
-            // Find the name from the list of states
-            for (const auto& state: states_)
-                if (state.id() == state_id)
-                    return &state;
-
-            return nullptr;
+            image_ = {};
+            image_hits_.reset();
+            image_latency_.reset();
+            return *this;
         }
 
-        static inline constexpr auto npos = std::size_t(~0U);
+        // It returns the attached transition image. It evaluates to false if no image is attached.
+        const transition_image& image() const noexcept { return image_; }
 
-        // It finds the state vector index where the state with the given name lives.
-        // It returns npos if the id is not found.
-        std::size_t find_index(const state_id_type state_id) const noexcept
+        // It registers a factory which creates state coroutines on demand (see add_lazy_state).
+        // A factory can be shared by any number of lazy states. It returns the index of the factory.
+        std::size_t add_state_factory(state_factory factory)
         {
-            for (std::size_t i = 0U; i < states_.size(); ++i)
-                if (states_[i].id() == state_id)
-                    return i;
+            if (!factory)
+            {
+                auto error_message = create_error_message();
+                error_message << "attempt to add an empty state factory.";
+                throw std::runtime_error(error_message.str());
+            }
 
-            return npos;
+            factories_.push_back(std::move(factory));
+            return factories_.size() - 1U;
         }
 
-        // It returns true if the given state is registered in the fsm.
-        bool has_state(const state_id_type id) const noexcept
+        // It adds a state whose coroutine is created by the factory at 'factory_index' when the state is entered for the
+        // first time (by a transition or by go_to). The coroutine is started past its initial suspension at that point,
+        // so start() does not have to resume it. Until then the state takes only a slot in the state table, so the start-up
+        // time and the memory of huge sparse FSMs scale with the visited states instead of the declared states.
+        // Transitions can be added from and to a lazy state by its id as for any other state.
+        // It returns the index of the vector to which the state was stored.
+        std::size_t add_lazy_state(const state_id_type id, const std::size_t factory_index)
         {
-            // Find the name from the list of states
-            for (const state_type& state: states_)
-                if (state.id() == id)
-                    return true;
-            return false;
+            if (factory_index >= factories_.size())
+            {
+                auto error_message = create_error_message();
+                error_message << "state factory " << factory_index << " of state '" << id << "' does not exist.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            return add_slot(id, static_cast<std::uint32_t>(factory_index));
         }
 
-        // It gives access to the logger.
-        const logger_functor& logger() const noexcept { return logger_; }
-        // It sets the logger.
-        void set_logger(logger_functor item) { logger_ = std::move(item); }
+        std::size_t add_lazy_state(const state_id_type id, state_factory factory)
+        {
+            return add_lazy_state(id, add_state_factory(std::move(factory)));
+        }
 
-    private:
-        using state_handle_event_id_pair = _State_handle_event_id_pair<state_handle_type, event_id_type>;
-        using transition_map = std::unordered_map<state_handle_event_id_pair, transition_target, typename state_handle_event_id_pair::hash>;
+        // It returns reference to the state object at the given index.
+        // The state object of a lazy state is empty until the state is entered for the first time.
+        const state_type& state_at(const std::size_t index) const { return states_.at(index).state; }
 
-        // Find the handle based on id. It returns an empty state handle if the id is not found.
-        state_handle_type find_handle(const state_id_type id) const
+        // It returns the id of the state at the given index.
+        state_id_type state_id_at(const std::size_t index) const { return states_.at(index).id; }
+
+        // It returns the number of states in the FSM.
+        std::size_t state_count() const noexcept { return states_.size(); }
+
+        // It returns the number of states whose coroutines have been created.
+        std::size_t materialized_state_count() const noexcept { return materialized_count_; }
+
+        // It returns true if the coroutine of the state at the given index has been created.
+        bool is_materialized(const std::size_t index) const { return static_cast<bool>(states_.at(index).state.handle()); }
+
+        // It sets the eviction policy of the lazy states.
+        // When the resident coroutine frames take more than policy.frame_budget bytes, the frames of the least recently
+        // entered lazy states are destroyed while they are suspended and waiting for an event. An evicted state is
+        // re-created by its factory when it is entered again, so anything which must survive the eviction has to be kept
+        // outside the frame; on_evict and on_restore let the handlers persist and restore it.
+        // States added by add_state are never evicted since they can't be re-created. Neither is the current state.
+        automaton& set_eviction_policy(eviction_policy policy)
         {
-            // Find the name from the list of states
-            for (const state_type& state: states_)
-                if (state.id() == id)
-                    return state.handle();
-            return {};
+            eviction_ = std::move(policy);
+            lru_head_ = lru_tail_ = no_state;
+            if (eviction_.frame_budget != 0U)
+            {
+                // Link the resident lazy states in the order of their indices.
+                for (std::size_t i = 0U; i < states_.size(); ++i)
+                    if (states_[i].factory != no_factory && states_[i].state.handle())
+                        lru_push_front(static_cast<std::uint32_t>(i));
+                evict_over_budget(no_state);
+            }
+
+            return *this;
         }
 
-        logger_functor logger_ {};       // Callback for debugging and writing log. It is called when the state of
-                                         // the fsm whose id is in the first argument is about to change from 'from_state' to 'to_state'
-                                         // because the from_state is sending event 'on_event'.
-        transition_map transitions_;     // Transition table in format {from-state, event} -> to-state. That is, an event sent from
-                                         // from-state will be routed to to-state.
-        std::vector<state_type> states_; // All coroutines which represent the states in the state machine.
+        const eviction_policy& get_eviction_policy() const noexcept { return eviction_; }
+
+        // It returns the size of the coroutine frame of the state at the given index in bytes.
+        // For an evicted or not yet created lazy state it returns the size of its latest frame (or zero).
+        std::size_t frame_size(const std::size_t index) const { return states_.at(index).frame_size; }
+
+        // It returns the total size of the resident coroutine frames in bytes.
+        std::size_t resident_frame_bytes() const noexcept { return resident_frame_bytes_; }
+
+        // It returns how many times the frame of the state at the given index has been evicted.
+        std::uint32_t eviction_count(const std::size_t index) const { return states_.at(index).evictions; }
+
+        // It returns how many times frames have been evicted in the FSM.
+        std::uint64_t eviction_count() const noexcept { return eviction_count_; }
+
+        // It renumbers the states by a profile of transition counts (e.g. from get_transition_counts of a recorded run or
+        // from read_transition_profile) to improve the locality of the hot paths:
+        //  - the hottest successor of a state gets the next index, so hot chains of states take adjacent state slots;
+        //  - the transition table is rebuilt from the coldest to the hottest entry, so the hot keys come first in their
+        //    buckets (the latest inserted key comes first in the buckets of the common node-based hash tables);
+        //  - if 'recreate_frames' is true, the coroutine frames of the resident lazy states are re-created by their
+        //    factories in the new order, so the frames of hot states tend to be allocated next to each other. Their data is
+        //    lost as if they were evicted (the on_evict and on_restore hooks of the eviction policy are called).
+        // The transitions of other FSMs which lead into this FSM are renumbered as well. Transitions of the profile whose
+        // states are unknown are ignored. It must not be called while this FSM or an FSM with transitions into it is
+        // running or destroyed, nor while a transition image is attached since the image refers to the states by index.
+        automaton& relayout(const transition_count::vector& profile, const bool recreate_frames = false)
+        {
+            if (image_)
+            {
+                auto error_message = create_error_message();
+                error_message << "the states can't be renumbered while a transition image is attached.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            const auto order = hot_order(profile); // New index -> old index.
+            std::vector<state_index_type> new_index(states_.size());
+            for (std::size_t i = 0U; i < order.size(); ++i)
+                new_index[order[i]] = i;
+
+            const auto renumber = [&](const std::uint32_t index) { return index != no_state ? std::uint32_t(new_index[index]) : no_state; };
+            std::vector<state_slot> states {};
+            states.reserve(states_.size());
+            for (const auto index: order)
+            {
+                auto& slot = states.emplace_back(std::move(states_[index]));
+                slot.lru_previous = renumber(slot.lru_previous);
+                slot.lru_next = renumber(slot.lru_next);
+            }
+
+            states_ = std::move(states);
+            lru_head_ = renumber(lru_head_);
+            lru_tail_ = renumber(lru_tail_);
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+            {
+                state_indices_[states_[i].id] = i;
+                if (states_[i].state.handle())
+                    states_[i].state.handle().promise().index = i;
+            }
+
+            // The heat of the entries of this FSM comes from the profile, the heat of the entries of other FSMs from their counters.
+            // The profile is sorted by {from-state, event} and searched since it can be as large as the transition table.
+            std::vector<std::pair<state_handle_event_id_pair, std::uint64_t>> heat {};
+            heat.reserve(profile.size());
+            for (const auto& [item, count]: profile)
+                if (const auto from_index = find_index(item.from); from_index != npos)
+                    heat.push_back({{from_index, item.event}, count});
+            std::ranges::sort(heat, {}, [](const auto& item) { return item.first; });
+
+            renumber_transitions(*this, new_index,
+                                 [&](const state_handle_event_id_pair& key, const transition_target&)
+                                 {
+                                     const auto it = std::ranges::lower_bound(heat, key, {}, [](const auto& item) { return item.first; });
+                                     return it != heat.end() && it->first == key ? it->second : 0U;
+                                 });
+            for (auto* const referrer: copy_referrers())
+                referrer->renumber_transitions(*this, new_index,
+                                               [referrer](const state_handle_event_id_pair&, const transition_target& target)
+                                               {
+                                                   auto& hits = referrer->edge_at(target.edge).hits;
+                                                   return std::atomic_ref<std::uint64_t>(hits).load(std::memory_order_relaxed);
+                                               });
+
+            if (recreate_frames)
+                recreate_lazy_frames();
+            return *this;
+        }
+
+        // It allocates the per-thread resources which the calling thread needs to run the FSM (its reader record of
+        // epoch_domain, its free lists of payload_pool and its buffer of the trace recorder), so the transitions made
+        // by the thread don't allocate.
+        // start() calls it for its thread; other threads which send events should call it before they run the FSM.
+        automaton& prepare_thread()
+        {
+            epoch_domain::instance().register_thread();
+            payload_pool::instance().register_thread();
+            if (tracer_)
+                tracer_->register_thread();
+            return *this;
+        }
+
+        // It gets the states going from the initial suspension.
+        // Lazy states which have not been entered yet are not created.
+        automaton& start()
+        {
+            CO_FSM_PROBE(start, detail::to_trace_integer(id_), states_.size());
+            prepare_thread();
+            for (auto& slot: states_)
+                if (slot.state.handle() && !slot.state.is_started()) // Resume only if the coroutine is still suspended in initial_suspend.
+                    slot.state.handle().resume();
+            return *this;
+        }
+
+        // It returns the number of transitions made by this FSM (a transition into another FSM is made by the source FSM).
+        // It can be called while the FSM is running on another thread.
+        std::uint64_t transitions_made() const noexcept
+        {
+            return std::atomic_ref<std::uint64_t>(const_cast<std::uint64_t&>(transitions_made_)).load(std::memory_order_relaxed);
+        }
+
+        // It measures every 'period'-th send_event call from the injection of the event until the FSM suspends:
+        // the wall time, the CPU time of the calling thread and the number of transitions of this FSM.
+        // The calls which are not measured cost a decrement, so a period of e.g. 1000 is cheap enough for production.
+        // A period of zero disables the sampling. The statistics (three histograms of 8 KiB) are allocated when the sampling
+        // is enabled the first time and kept when it is disabled.
+        automaton& enable_send_event_sampling(const std::uint32_t period)
+        {
+            if (period != 0U)
+            {
+                latency_clock::calibrate();
+                if (!send_event_statistics_)
+                    send_event_statistics_ = std::make_unique<send_event_statistics>();
+            }
+            sample_period_ = period;
+            sample_countdown_ = period;
+            return *this;
+        }
+
+        std::uint32_t send_event_sampling_period() const noexcept { return sample_period_; }
+
+        // It returns a snapshot of the statistics of the sampled send_event calls (empty if the sampling was never enabled).
+        // It can be called while the FSM is running on another thread.
+        send_event_statistics get_send_event_statistics() const
+        {
+            const auto load = [](const std::uint64_t& value)
+            { return std::atomic_ref<std::uint64_t>(const_cast<std::uint64_t&>(value)).load(std::memory_order_relaxed); };
+
+            send_event_statistics result {};
+            if (!send_event_statistics_)
+                return result;
+
+            result.injections = load(send_event_statistics_->injections);
+            result.sampled = load(send_event_statistics_->sampled);
+            result.wall_time = send_event_statistics_->wall_time;
+            result.cpu_time = send_event_statistics_->cpu_time;
+            result.transitions = send_event_statistics_->transitions;
+            return result;
+        }
+
+        // It clears the statistics of the sampled send_event calls.
+        automaton& reset_send_event_statistics()
+        {
+            if (!send_event_statistics_)
+                return *this;
+
+            std::atomic_ref<std::uint64_t>(send_event_statistics_->injections).store(0U, std::memory_order_relaxed);
+            std::atomic_ref<std::uint64_t>(send_event_statistics_->sampled).store(0U, std::memory_order_relaxed);
+            send_event_statistics_->wall_time.reset();
+            send_event_statistics_->cpu_time.reset();
+            send_event_statistics_->transitions.reset();
+            return *this;
+        }
+
+        // It kicks off the state machine by sending the event.
+        // It sends to the state which is either the state where the FSM left off when it was
+        // suspended last time or the state which has been explicitly set by calling set_state().
+        automaton& send_event(event_type&& event)
+        {
+            if (is_paused_) [[unlikely]]
+            {
+                fire_error_probe(probe_error::paused, state_.promise().id, event.id());
+                auto error_message = create_error_message();
+                error_message << std::source_location::current().function_name() << '(' << event.id()
+                              << ") can not be called because the FSM is paused at state " << state_.promise().id
+                              << " with a pending event. Call first fsm.resume() to finish it.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            if (state_.promise().is_started)
+            {
+                const detail::run_scope scope {};
+                // The transition tables seen until the FSM suspends are protected from reclamation (see set_live_updates).
+                const epoch_guard guard {live_updates_};
+                event_ = std::move(event);
+                budget_left_ = budget_;
+                is_active_.store(true, std::memory_order_relaxed);
+                if (publish_status_) [[unlikely]]
+                    publish_status(event_.id(), true);
+                CO_FSM_PROBE(send_event, detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id),
+                             detail::to_trace_integer(event_.id()));
+                if (tracer_) [[unlikely]]
+                    tracer_->enter(detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id),
+                                   detail::to_trace_integer(event_.id()));
+                if (measure_latency_) [[unlikely]]
+                    entered_at_ = latency_clock::now();
+                if (sample_period_ != 0U && send_event_statistics_) [[unlikely]]
+                {
+                    count(send_event_statistics_->injections);
+                    if (--sample_countdown_ == 0U)
+                    {
+                        sample_countdown_ = sample_period_;
+                        run_or_stop([this] { resume_sampled(); });
+                        return *this;
+                    }
+                }
+
+                run_or_stop([this] { state_.resume(); });
+                return *this;
+            }
+
+            fire_error_probe(probe_error::not_started, state_.promise().id, event.id());
+            auto error_message = create_error_message();
+            error_message << std::source_location::current().function_name() << '(' << event.id() << ") can not resume state "
+                          << state_.promise().id << " because it has not been started. Call first fsm.start() to activate all states.";
+            throw std::runtime_error(error_message.str());
+        }
+
+        // It limits the number of transitions which a send_event or resume call makes within this FSM, so a long chain of
+        // transitions doesn't keep the other FSMs of the thread waiting. When the budget is exhausted, the FSM pauses at
+        // the next transition: the transition is taken but its target state is not resumed, the event stays pending and
+        // the call returns. resume() continues where the FSM paused with a new budget. A transition into another FSM
+        // gives that FSM its own budget. A budget of zero means no limit; then a transition costs a compare.
+        automaton& set_transition_budget(const std::uint64_t budget) noexcept
+        {
+            budget_ = budget == 0U ? 0U : budget + 1U;
+            return *this;
+        }
+
+        std::uint64_t transition_budget() const noexcept { return budget_ == 0U ? 0U : budget_ - 1U; }
+
+        // It returns true if the FSM has paused because its transition budget is exhausted or the channel of the FSM which
+        // it hands off to is full (see is_blocked and resume).
+        bool is_paused() const noexcept { return is_paused_; }
+
+        // It returns true if the FSM has paused since the channel of the FSM which it hands off to is full (see set_channel).
+        // The FSM keeps the event of the handoff until resume() finds room in the channel.
+        bool is_blocked() const noexcept { return blocked_handoff_.fsm != nullptr; }
+
+        // It resumes a blocked FSM until its event is queued, backing off (spin, yield, then sleep) while the channel is full.
+        // It is meant for the thread which runs the first FSM of a pipeline; a pipeline_stage resumes its FSM by itself.
+        automaton& wait_for_channel()
+        {
+            for (std::uint32_t idle_rounds = 0U; is_blocked(); resume())
+                detail::idle_backoff(++idle_rounds);
+            return *this;
+        }
+
+        // It continues a paused FSM: the target state of the pending transition receives the pending event.
+        // A blocked FSM (see is_blocked) tries again to queue the event of its handoff and stays paused if the channel is
+        // still full. It does nothing if the FSM is not paused. It returns when the FSM suspends or pauses again.
+        automaton& resume()
+        {
+            if (!is_paused_)
+                return *this;
+            if (blocked_handoff_.fsm != nullptr) [[unlikely]]
+                return retry_handoff();
+
+            const detail::run_scope scope {};
+            const epoch_guard guard {live_updates_};
+            is_paused_ = false;
+            budget_left_ = budget_;
+            CO_FSM_PROBE(resume, detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id));
+            if (tracer_) [[unlikely]]
+                tracer_->enter(detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id),
+                               detail::to_trace_integer(event_.id()));
+            if (measure_latency_) [[unlikely]]
+                entered_at_ = latency_clock::now();
+            is_active_.store(true, std::memory_order_relaxed);
+            if (publish_status_) [[unlikely]]
+                publish_status(true);
+            run_or_stop([this] { state_.resume(); });
+            return *this;
+        }
+
+        // Event handed off to the FSM through its channel and its target state (npos for the current state).
+        struct channel_message
+        {
+            state_index_type state {npos};
+            event_type event {};
+        };
+
+        using channel_type = spsc_queue<channel_message>;
+
+        // It makes the FSM a stage of a pipeline which runs on its own thread (see pipeline_stage): a transition of another
+        // FSM into this FSM queues the event into the channel and suspends the source FSM, instead of resuming the target
+        // state on the thread of the source FSM. The thread of the stage runs the queued events by drain_channel.
+        // The channel has a single producer, so the FSMs which hand off to this FSM must run on a single thread. A transition
+        // into a full channel doesn't wait for room: the source FSM pauses with the event (see is_blocked) and resume()
+        // queues it later, so the thread of the source isn't held by a slow stage. The stages must form a chain or a DAG,
+        // since stages which hand off to each other in a cycle wait for each other forever once their channels are full.
+        // A null channel restores the direct handoffs. It must be called while the FSMs which hand off to this FSM are
+        // suspended (not paused).
+        automaton& set_channel(channel_type* const channel) noexcept
+        {
+            channel_ = channel;
+            return *this;
+        }
+
+        channel_type* get_channel() const noexcept { return channel_; }
+
+        // It runs up to 'max_count' events queued into the channel, each until the FSM suspends. It returns the number of
+        // events taken from the channel. If an event throws, the rest of the batch is dropped and the exception is rethrown.
+        // It must be called by the thread which runs the FSM.
+        // The transition budget (see set_transition_budget) is kept: if the FSM pauses (on its budget or a full channel of
+        // the next FSM), the batch ends and the next call resumes the FSM without taking events, so the queued events wait
+        // until the pending one is finished.
+        std::size_t drain_channel(const std::size_t max_count)
+        {
+            if (is_paused_)
+            {
+                resume();
+                return 0U;
+            }
+
+            std::exception_ptr error {};
+            const auto run = [this, &error](channel_message& message) noexcept
+            {
+                if (error)
+                    return true;
+
+                try
+                {
+                    run_message(message);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                    return true;
+                }
+
+                return !is_paused_;
+            };
+
+            const auto count = channel_->consume_batch(run, max_count);
+            if (error)
+                std::rethrow_exception(error);
+            return count;
+        }
+
+        // It finds the state based on state id.
+        // It returns null if the id is not found.
+        const state_type* find_state(const state_id_type state_id) const noexcept
+        {
+            const auto index = find_index(state_id);
+            return index != npos ? &states_[index].state : nullptr;
+        }
+
+        static inline constexpr auto npos = std::size_t(~0U);
+
+        // It finds the state vector index where the state with the given name lives.
+        // It returns npos if the id is not found.
+        std::size_t find_index(const state_id_type state_id) const noexcept
+        {
+            const auto it = state_indices_.find(state_id);
+            return it != state_indices_.end() ? it->second : npos;
+        }
+
+        // It returns true if the given state is registered in the fsm.
+        bool has_state(const state_id_type id) const noexcept { return state_indices_.contains(id); }
+
+        // It records the timeline of the FSM into 'recorder' (see trace.hpp) or stops recording if it is null.
+        // The names of the FSM, its states and the events of its transitions are registered in the recorder.
+        // The recorder must outlive the recording.
+        automaton& set_trace_recorder(trace_recorder* const recorder)
+        {
+            if (recorder != nullptr)
+            {
+                const auto name = [](const auto& id)
+                {
+                    std::ostringstream out {};
+                    out << id;
+                    return out.str();
+                };
+
+                const auto fsm = detail::to_trace_integer(id_);
+                recorder->name_fsm(fsm, name(id_));
+                for (const auto& slot: states_)
+                    recorder->name_state(fsm, detail::to_trace_integer(slot.id), name(slot.id));
+                for (const auto& item: get_transitions())
+                    recorder->name_event(detail::to_trace_integer(item.event), name(item.event));
+            }
+
+            tracer_ = recorder;
+            return prepare_thread();
+        }
+
+        trace_recorder* get_trace_recorder() const noexcept { return tracer_; }
+
+        // It gives access to the logger.
+        const logger_functor& logger() const noexcept { return logger_; }
+        // It sets the logger.
+        void set_logger(logger_functor item) { logger_ = std::move(item); }
+
+    private:
+        using state_handle_event_id_pair = _State_handle_event_id_pair<state_index_type, event_id_type>;
+        using transition_map = std::unordered_map<state_handle_event_id_pair, transition_target, typename state_handle_event_id_pair::hash>;
+        // The number of transitions into each other FSM, so an FSM is a referrer of exactly the FSMs which it has
+        // transitions into.
+        using target_counts = std::vector<std::pair<automaton*, std::size_t>>;
+
+        static inline constexpr auto no_factory = std::uint32_t(~0U);
+        static inline constexpr auto no_state = std::uint32_t(~0U);
+        static inline constexpr auto no_edge = std::uint32_t(~0U);
+        static inline constexpr std::size_t first_edge_block_size = 64U;
+
+        // Hit counter and latency histogram of a transition of the transition map (see transition_target::edge).
+        // The thread which runs the FSM updates them through atomic_ref, so they can be read while it runs.
+        struct edge_statistics
+        {
+            std::uint64_t hits {};
+            latency_histogram* latency {};
+        };
+
+        // Entry of the state table.
+        struct state_slot
+        {
+            state_type state {};                // Coroutine of the state. It is empty until a lazy state is entered.
+            state_id_type id {};                // Id of the state (also available before the coroutine exists).
+            std::uint32_t factory {no_factory}; // Index of the factory which creates the coroutine of a lazy state.
+            std::uint32_t frame_size {};        // Size of the latest coroutine frame of the state.
+            std::uint32_t evictions {};         // Number of times the frame has been evicted.
+            std::uint32_t lru_previous {no_state}; // Neighbours in the list of resident lazy states (most recently entered first).
+            std::uint32_t lru_next {no_state};
+        };
+
+        std::size_t add_slot(const state_id_type id, const std::uint32_t factory)
+        {
+            if (has_state(id))
+            {
+                std::ostringstream error_message {};
+                error_message << "A state with id '" << id << "' already exists in FSM " << id_;
+                throw std::runtime_error(error_message.str());
+            }
+
+            if (image_)
+            {
+                auto error_message = create_error_message();
+                error_message << "states can't be added while a transition image is attached.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            const auto index = states_.size();
+            states_.push_back(state_slot {{}, id, factory});
+            state_indices_.emplace(id, index);
+            return index;
+        }
+
+        bool add_transition_at(const state_index_type from, const event_id_type on_event, const state_index_type to,
+                               automaton* const target_fsm)
+        {
+            std::lock_guard lock {update_mutex_};
+            if (target_fsm != this)
+                target_fsm->add_referrer(this);
+
+            auto& transitions = transitions_.load(std::memory_order_relaxed)->map;
+            const state_handle_event_id_pair key {from, on_event};
+            const auto it = transitions.find(key);
+            const auto previous_fsm = it != transitions.end() ? it->second.fsm : nullptr;
+            const auto edge = it != transitions.end() ? it->second.edge : new_edge();
+            const bool inserted = transitions.insert_or_assign(key, transition_target {std::uint32_t(to), edge, target_fsm}).second;
+            retarget(targets_, previous_fsm, target_fsm);
+            release_targets();
+            return inserted;
+        }
+
+        bool remove_transition_at(const state_index_type from, const event_id_type on_event)
+        {
+            std::lock_guard lock {update_mutex_};
+            auto& transitions = transitions_.load(std::memory_order_relaxed)->map;
+            const auto it = transitions.find({from, on_event});
+            if (it == transitions.end())
+                return false;
+
+            const auto previous_fsm = it->second.fsm;
+            transitions.erase(it);
+            retarget(targets_, previous_fsm, nullptr);
+            release_targets();
+            return true;
+        }
+
+        // It returns the handle of the state at 'index'. A lazy state is created if it has not been entered yet.
+        state_handle_type resolve(const state_index_type index)
+        {
+            if (eviction_.frame_budget != 0U) [[unlikely]]
+                return resolve_with_eviction(index);
+
+            const state_handle_type& handle = states_[index].state.handle();
+            return handle ? handle : materialize(index);
+        }
+
+        state_handle_type resolve_with_eviction(const state_index_type index)
+        {
+            auto& slot = states_[index];
+            if (slot.factory == no_factory)
+                return slot.state.handle() ? slot.state.handle() : materialize(index);
+
+            const auto lru_index = static_cast<std::uint32_t>(index);
+            if (slot.state.handle())
+            {
+                lru_unlink(lru_index);
+                lru_push_front(lru_index);
+                return slot.state.handle();
+            }
+
+            const bool restored = slot.evictions != 0U;
+            const state_handle_type handle = materialize(index);
+            lru_push_front(lru_index);
+            if (restored && eviction_.on_restore)
+                eviction_.on_restore(*this, slot.id);
+
+            evict_over_budget(lru_index);
+            return handle;
+        }
+
+        // It destroys the frames of the least recently entered lazy states until the resident frames fit in the budget.
+        // The state at 'keep' and the current state are not evicted.
+        void evict_over_budget(const std::uint32_t keep)
+        {
+            for (auto index = lru_tail_; index != no_state && resident_frame_bytes_ > eviction_.frame_budget;)
+            {
+                auto& slot = states_[index];
+                const auto previous = slot.lru_previous;
+                if (index != keep && slot.state.handle() != state_)
+                {
+                    if (eviction_.on_evict)
+                        eviction_.on_evict(*this, slot.id);
+
+                    lru_unlink(index);
+                    resident_frame_bytes_ -= slot.state.frame_size();
+                    slot.state = state_type {}; // The coroutine is destroyed while it awaits an event.
+                    ++slot.evictions;
+                    ++eviction_count_;
+                    --materialized_count_;
+                }
+
+                index = previous;
+            }
+        }
+
+        void lru_push_front(const std::uint32_t index) noexcept
+        {
+            auto& slot = states_[index];
+            slot.lru_previous = no_state;
+            slot.lru_next = lru_head_;
+            if (lru_head_ != no_state)
+                states_[lru_head_].lru_previous = index;
+            else
+                lru_tail_ = index;
+            lru_head_ = index;
+        }
+
+        void lru_unlink(const std::uint32_t index) noexcept
+        {
+            auto& slot = states_[index];
+            if (slot.lru_previous != no_state)
+                states_[slot.lru_previous].lru_next = slot.lru_next;
+            else
+                lru_head_ = slot.lru_next;
+
+            if (slot.lru_next != no_state)
+                states_[slot.lru_next].lru_previous = slot.lru_previous;
+            else
+                lru_tail_ = slot.lru_previous;
+
+            slot.lru_previous = slot.lru_next = no_state;
+        }
+
+        // It creates the coroutine of a lazy state and gets it going from the initial suspension.
+        state_handle_type materialize(const state_index_type index)
+        {
+            auto& slot = states_[index];
+            if (slot.factory == no_factory)
+            {
+                fire_error_probe(probe_error::invalid_state, slot.id, event_.is_valid() ? event_.id() : event_id_type {});
+                auto error_message = create_error_message();
+                error_message << "state '" << slot.id << "' has neither a coroutine nor a factory.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            state_type state = factories_[slot.factory](*this, slot.id);
+            if (!state.handle())
+            {
+                fire_error_probe(probe_error::invalid_state, slot.id, event_.is_valid() ? event_.id() : event_id_type {});
+                auto error_message = create_error_message();
+                error_message << "the factory of state '" << slot.id << "' returned an invalid state.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            auto& promise = state.handle().promise();
+            promise.id = slot.id;
+            promise.index = index;
+            if (!promise.is_started)
+                state.handle().resume(); // The coroutine runs until it awaits the first event.
+
+            slot.frame_size = static_cast<std::uint32_t>(state.frame_size());
+            resident_frame_bytes_ += state.frame_size();
+            slot.state = std::move(state);
+            ++materialized_count_;
+            return slot.state.handle();
+        }
+
+        // It calls f(transition, hit counter, latency histogram) for each transition.
+        // The transitions of the attached transition image come first, followed by the transitions
+        // which are not covered by the image.
+        template <typename _Function>
+        void for_each_transition(_Function&& f) const
+        {
+            const epoch_guard guard {};
+            if constexpr (supports_images)
+            {
+                for (std::size_t i = 0U; image_ && i < image_.state_count(); ++i)
+                    for (std::uint32_t e = 0U; e < image_.event_count(); ++e)
+                    {
+                        const auto slot = image_.slot(i, e);
+                        if (const auto to_index = image_.target_at(slot); to_index != transition_image::npos)
+                        {
+                            std::uint64_t no_hits {};
+                            latency_histogram* no_latency {};
+                            f(transition {states_[i].id, detail::from_integer<event_id_type>(e), states_[to_index].id,
+                                          const_cast<automaton*>(this)},
+                              image_hits_ ? image_hits_[slot] : no_hits, image_latency_ ? image_latency_[slot] : no_latency);
+                        }
+                    }
+            }
+
+            for (const auto& [from_state_on_event, to_state]: transitions_.load(std::memory_order_acquire)->map)
+                if (!covered_by_image(from_state_on_event.first, from_state_on_event.second))
+                {
+                    auto& statistics = edge_at(to_state.edge);
+                    f(transition {states_[from_state_on_event.first].id, from_state_on_event.second,
+                                  to_state.fsm->states_[to_state.state].id, to_state.fsm},
+                      statistics.hits, statistics.latency);
+                }
+        }
+
+        // It returns the state indices in the new order (see relayout): states are placed in chains which follow the
+        // hottest successor which has not been placed yet, and the chains start from the hottest states.
+        // The states which do not appear in the profile keep their relative order at the end.
+        std::vector<state_index_type> hot_order(const transition_count::vector& profile) const
+        {
+            struct edge
+            {
+                std::uint32_t from;
+                std::uint32_t to;
+                std::uint64_t count;
+            };
+
+            std::vector<edge> edges {};
+            std::vector<std::uint64_t> heat(states_.size());
+            for (const auto& [item, count]: profile)
+            {
+                if (count == 0U || (item.target != nullptr && item.target != this))
+                    continue;
+
+                const auto from_index = find_index(item.from);
+                const auto to_index = find_index(item.to);
+                if (from_index == npos || to_index == npos)
+                    continue;
+
+                edges.push_back({std::uint32_t(from_index), std::uint32_t(to_index), count});
+                heat[from_index] += count;
+                heat[to_index] += count;
+            }
+
+            // Successors of each state from the hottest to the coldest.
+            std::ranges::sort(edges, [](const edge& lhs, const edge& rhs)
+                              { return lhs.from != rhs.from ? lhs.from < rhs.from : lhs.count > rhs.count; });
+            std::vector<std::size_t> first_edge(states_.size() + 1U);
+            for (const auto& item: edges)
+                ++first_edge[item.from + 1U];
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+                first_edge[i + 1U] += first_edge[i];
+
+            std::vector<state_index_type> seeds {};
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+                if (heat[i] != 0U)
+                    seeds.push_back(i);
+            std::ranges::stable_sort(seeds, [&](const auto lhs, const auto rhs) { return heat[lhs] > heat[rhs]; });
+
+            std::vector<state_index_type> order {};
+            order.reserve(states_.size());
+            std::vector<bool> placed(states_.size());
+            for (const auto seed: seeds)
+            {
+                for (auto index = seed; index != npos && !placed[index];)
+                {
+                    placed[index] = true;
+                    order.push_back(index);
+
+                    const auto begin = edges.begin() + std::ptrdiff_t(first_edge[index]);
+                    const auto end = edges.begin() + std::ptrdiff_t(first_edge[index + 1U]);
+                    const auto next = std::find_if(begin, end, [&](const edge& item) { return !placed[item.to]; });
+                    index = next != end ? next->to : npos;
+                }
+            }
+
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+                if (!placed[i])
+                    order.push_back(i);
+            return order;
+        }
+
+        // It publishes a copy of the transition table in which the states of 'fsm' are renumbered by 'new_index'.
+        // The entries are inserted in the order of increasing heat(key, target), so the hot keys come first in their buckets.
+        template <typename _Heat>
+        void renumber_transitions(const automaton& fsm, const std::vector<state_index_type>& new_index, _Heat&& heat)
+        {
+            std::lock_guard lock {update_mutex_};
+            const auto* const current = transitions_.load(std::memory_order_relaxed);
+            std::vector<std::pair<std::uint64_t, const typename transition_map::value_type*>> entries {};
+            entries.reserve(current->map.size());
+            for (const auto& entry: current->map)
+                entries.emplace_back(heat(entry.first, entry.second), &entry);
+            std::ranges::stable_sort(entries, {}, [](const auto& item) { return item.first; });
+
+            auto next = std::make_unique<transition_table>();
+            next->version = current->version + 1U;
+            next->map.reserve(entries.size());
+            for (const auto& [entry_heat, entry]: entries)
+            {
+                auto key = entry->first;
+                auto target = entry->second;
+                if (this == &fsm)
+                    key.first = new_index[key.first];
+                if (target.fsm == &fsm)
+                    target.state = std::uint32_t(new_index[target.state]);
+                next->map.emplace(key, target);
+            }
+
+            transitions_.store(next.release(), std::memory_order_release);
+            epoch_domain::instance().retire(current);
+        }
+
+        // It re-creates the coroutine frames of the resident lazy states in the order of their indices.
+        // The current state is kept since it may be suspended in the middle of its handler.
+        void recreate_lazy_frames()
+        {
+            std::vector<state_index_type> recreated {};
+            for (std::size_t i = 0U; i < states_.size(); ++i)
+            {
+                auto& slot = states_[i];
+                if (slot.factory == no_factory || !slot.state.handle() || slot.state.handle() == state_)
+                    continue;
+
+                if (eviction_.on_evict)
+                    eviction_.on_evict(*this, slot.id);
+                resident_frame_bytes_ -= slot.state.frame_size();
+                slot.state = state_type {};
+                --materialized_count_;
+                recreated.push_back(i);
+            }
+
+            // All frames are destroyed first, so the new frames can reuse the memory in the new order.
+            for (const auto index: recreated)
+            {
+                static_cast<void>(materialize(index));
+                if (eviction_.on_restore)
+                    eviction_.on_restore(*this, states_[index].id);
+            }
+        }
+
+        // It registers an FSM which has transitions into this FSM (see relayout).
+        void add_referrer(automaton* const fsm)
+        {
+            std::lock_guard lock {referrers_mutex_};
+            if (std::ranges::find(referrers_, fsm) == referrers_.end())
+                referrers_.push_back(fsm);
+        }
+
+        // It unregisters an FSM which has no transitions into this FSM anymore or is destroyed.
+        void remove_referrer(const automaton* const fsm)
+        {
+            std::lock_guard lock {referrers_mutex_};
+            std::erase(referrers_, fsm);
+        }
+
+        // It returns a copy of the referrers, so their tables can be locked without holding referrers_mutex_ (apply() of a
+        // referrer locks referrers_mutex_ while it holds the update_mutex_ of the referrer).
+        std::vector<automaton*> copy_referrers()
+        {
+            std::lock_guard lock {referrers_mutex_};
+            return referrers_;
+        }
+
+        // It forgets an FSM which this FSM has transitions into since the FSM is destroyed.
+        void forget_target(const automaton* const fsm)
+        {
+            std::lock_guard lock {update_mutex_};
+            std::erase_if(targets_, [fsm](const auto& item) { return item.first == fsm; });
+        }
+
+        // It moves a transition of the table from the FSM 'previous' into the FSM 'next' in the counts of transitions into
+        // other FSMs. A null FSM means the transition doesn't exist before or after the change.
+        void retarget(target_counts& targets, automaton* const previous, automaton* const next) const
+        {
+            if (previous == next)
+                return;
+
+            if (previous != nullptr && previous != this)
+                --std::ranges::find(targets, previous, &target_counts::value_type::first)->second;
+            if (next != nullptr && next != this)
+            {
+                const auto it = std::ranges::find(targets, next, &target_counts::value_type::first);
+                if (it != targets.end())
+                    ++it->second;
+                else
+                    targets.emplace_back(next, 1U);
+            }
+        }
+
+        // It unregisters this FSM from the FSMs which it has no transitions into anymore.
+        void release_targets()
+        {
+            std::erase_if(targets_,
+                          [this](const auto& item)
+                          {
+                              if (item.second != 0U)
+                                  return false;
+                              item.first->remove_referrer(this);
+                              return true;
+                          });
+        }
+
+        void trace_transition(const state_handle_type& from_state, const event_id_type on_event, const automaton& target_fsm,
+                              const state_handle_type& to_state) const noexcept
+        {
+            tracer_->transition(detail::to_trace_integer(id_), detail::to_trace_integer(from_state.promise().id),
+                                detail::to_trace_integer(on_event), detail::to_trace_integer(target_fsm.id_),
+                                detail::to_trace_integer(to_state.promise().id));
+        }
+
+        // It queues the event of a transition into the channel of the target FSM and suspends this FSM.
+        // If the channel is full, this FSM pauses with the event instead (see is_blocked).
+        std::coroutine_handle<> forward(const state_handle_type& from_state, const event_id_type on_event_id, const transition_target to)
+        {
+            if (!to.fsm->channel_->try_emplace(to.state, std::move(event_))) [[unlikely]]
+            {
+                is_paused_ = true;
+                blocked_handoff_ = to;
+                CO_FSM_PROBE(pause, detail::to_trace_integer(id_), detail::to_trace_integer(from_state.promise().id));
+                if (publish_status_) [[unlikely]]
+                    publish_status(on_event_id, false);
+                set_idle();
+                return std::noop_coroutine();
+            }
+
+            record_handoff(from_state.promise().id, on_event_id, to);
+            if (publish_status_) [[unlikely]]
+                publish_status(on_event_id, false);
+            set_idle();
+            return std::noop_coroutine();
+        }
+
+        // It tries again to queue the event of a blocked handoff (see forward). The FSM stays paused if the channel is full.
+        automaton& retry_handoff()
+        {
+            const auto to = blocked_handoff_;
+            const auto on_event_id = event_.id();
+            if (!to.fsm->channel_->try_emplace(to.state, std::move(event_)))
+                return *this;
+
+            is_paused_ = false;
+            blocked_handoff_ = {};
+            record_handoff(state_.promise().id, on_event_id, to);
+            if (publish_status_) [[unlikely]]
+                publish_status(false);
+            return *this;
+        }
+
+        // It reports a handoff whose event has been queued into the channel of the target FSM to the probe, the trace
+        // recorder and the logger. The ids of the states don't change once added, so the target state is named without
+        // touching its coroutine.
+        void record_handoff(const state_id_type from_state, const event_id_type on_event_id, const transition_target to) const
+        {
+            [[maybe_unused]] const auto to_state_id = to.fsm->states_[to.state].id;
+            CO_FSM_PROBE(handoff, detail::to_trace_integer(id_), detail::to_trace_integer(to.fsm->id_),
+                         detail::to_trace_integer(from_state), detail::to_trace_integer(on_event_id),
+                         detail::to_trace_integer(to_state_id));
+            if (tracer_) [[unlikely]]
+                tracer_->handoff(detail::to_trace_integer(id_), detail::to_trace_integer(from_state),
+                                 detail::to_trace_integer(on_event_id), detail::to_trace_integer(to.fsm->id_),
+                                 detail::to_trace_integer(to_state_id));
+            if (logger_)
+                logger_(id_, to.fsm->id_, from_state, on_event_id, to_state_id);
+        }
+
+        // It runs an event taken from the channel (see drain_channel, which doesn't take events while the FSM is paused).
+        void run_message(channel_message& message)
+        {
+            assert(!is_paused_);
+            if (message.state != npos)
+                state_ = resolve(message.state);
+            send_event(std::move(message.event));
+        }
+
+        // It fires the 'error' probe (see probes.hpp).
+        void fire_error_probe([[maybe_unused]] const probe_error error, [[maybe_unused]] const state_id_type state,
+                              [[maybe_unused]] const event_id_type event) const noexcept
+        {
+            CO_FSM_PROBE(error, detail::to_trace_integer(id_), unsigned(error), detail::to_trace_integer(state),
+                         detail::to_trace_integer(event));
+            if (status_slot_ != nullptr) [[unlikely]]
+                status_slot_->errors.fetch_add(1U, std::memory_order_relaxed);
+        }
+
+        // It resumes the current state and measures the time until the FSM suspends.
+        // It marks the FSM as suspended and wakes the waiters (see wait_idle).
+        // The light fence pairs with the heavy fence of add_waiter, so a waiter which registers concurrently either sees
+        // the FSM suspended or is counted here. Without waiters it costs a store and a load.
+        void set_idle() noexcept
+        {
+            is_active_.store(false, std::memory_order_release);
+            detail::light_fence();
+            if (waiters_.load(std::memory_order_relaxed) != 0U) [[unlikely]]
+                notify_idle();
+        }
+
+        // It marks the FSM idle when an exception leaves it (e.g. a missing transition under the throw_error policy),
+        // so the waiters (see wait_idle) return and the status doesn't show it running.
+        void stop_on_error() noexcept
+        {
+            if (publish_status_) [[unlikely]]
+                publish_status(false);
+            set_idle();
+        }
+
+        // It runs the FSM by calling 'run' and marks it idle if an exception leaves it.
+        template <typename _Run>
+        void run_or_stop(_Run&& run)
+        {
+            try
+            {
+                run();
+            }
+            catch (...)
+            {
+                stop_on_error();
+                throw;
+            }
+        }
+
+        void add_waiter() noexcept
+        {
+            waiters_.fetch_add(1U, std::memory_order_relaxed);
+            detail::heavy_fence();
+        }
+
+        void notify_idle() noexcept
+        {
+            is_active_.notify_all();
+            {
+                const std::lock_guard lock {waiter_mutex_};
+                if (idle_awaiters_ != nullptr && !idle_task_queued_)
+                {
+                    idle_task_queued_ = true;
+                    idle_task_ = {nullptr, &resume_idle_awaiters, this};
+                    detail::run_scope::defer(idle_task_);
+                }
+            }
+
+            waiter_condition_.notify_all();
+        }
+
+        bool add_idle_awaiter(idle_awaitable& item)
+        {
+            const std::lock_guard lock {waiter_mutex_};
+            add_waiter();
+            if (!is_active_.load(std::memory_order_acquire))
+            {
+                waiters_.fetch_sub(1U, std::memory_order_relaxed);
+                return false; // The FSM has been suspended meanwhile; the coroutine continues.
+            }
+
+            item.next = std::exchange(idle_awaiters_, &item);
+            return true;
+        }
+
+        // It resumes the coroutines which await the suspension of the FSM (in the order they started awaiting).
+        static void resume_idle_awaiters(void* const owner) noexcept
+        {
+            auto& self = *static_cast<automaton*>(owner);
+            idle_awaitable* items {};
+            {
+                const std::lock_guard lock {self.waiter_mutex_};
+                self.idle_task_queued_ = false;
+                if (self.is_active_.load(std::memory_order_relaxed))
+                    return; // The FSM runs again; they wait for its next suspension.
+
+                std::uint32_t count {};
+                for (auto* item = std::exchange(self.idle_awaiters_, nullptr); item != nullptr; ++count)
+                {
+                    auto* const next = item->next;
+                    item->next = std::exchange(items, item);
+                    item = next;
+                }
+                self.waiters_.fetch_sub(count, std::memory_order_relaxed);
+            }
+
+            while (items != nullptr)
+                std::exchange(items, items->next)->continuation.resume();
+        }
+
+        // It suspends the FSM in 'from_state' until the next send_event call.
+        std::coroutine_handle<> suspend(const state_handle_type& from_state) noexcept
+        {
+            if (tracer_) [[unlikely]]
+                tracer_->suspend(detail::to_trace_integer(id_), detail::to_trace_integer(from_state.promise().id));
+            // The event is kept (see latest_event) but a borrowed segment which it may still hold is released.
+            if constexpr (releases_borrowed_payload<event_type>)
+                event_.release_borrowed();
+            if (publish_status_) [[unlikely]]
+                publish_status(false);
+            set_idle();
+            return std::noop_coroutine();
+        }
+
+        // It pauses the FSM on an exhausted transition budget instead of resuming the current state (see resume).
+        std::coroutine_handle<> pause() noexcept
+        {
+            is_paused_ = true;
+            CO_FSM_PROBE(pause, detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id));
+            if (tracer_) [[unlikely]]
+                tracer_->suspend(detail::to_trace_integer(id_), detail::to_trace_integer(state_.promise().id));
+            if (publish_status_) [[unlikely]]
+                publish_status(false);
+            set_idle();
+            return std::noop_coroutine();
+        }
+
+        // It writes the status of a transition within the FSM (see enable_status). The timestamp is kept.
+        void publish_transition(const event_id_type event) noexcept
+        {
+            status_draft_.state = detail::to_status_id(state_.promise().id);
+            status_draft_.event = detail::to_status_id(event);
+            status_draft_.transitions = transitions_made_;
+            if (status_enabled_)
+                status_.store(status_draft_);
+            if (status_slot_ != nullptr)
+            {
+                status_slot_->state.store(detail::to_trace_integer(state_.promise().id), std::memory_order_relaxed);
+                status_slot_->event.store(detail::to_trace_integer(event), std::memory_order_relaxed);
+                status_slot_->transitions.store(transitions_made_, std::memory_order_relaxed);
+            }
+        }
+
+        // It writes the status when the FSM starts running or stops. The latest event is kept if no event is given.
+        void publish_status(const bool active) noexcept
+        {
+            if (state_)
+                status_draft_.state = detail::to_status_id(state_.promise().id);
+            status_draft_.is_active = active;
+            status_draft_.transitions = transitions_made_;
+            if (status_enabled_)
+            {
+                status_draft_.timestamp = latency_clock::now();
+                status_.store(status_draft_);
+            }
+
+            if (status_slot_ != nullptr)
+            {
+                if (state_)
+                    status_slot_->state.store(detail::to_trace_integer(state_.promise().id), std::memory_order_relaxed);
+                status_slot_->event.store(detail::to_trace_integer(status_draft_.event), std::memory_order_relaxed);
+                status_slot_->transitions.store(transitions_made_, std::memory_order_relaxed);
+                const auto flags = status_slot::in_use | (active ? status_slot::active : 0U) | (is_paused_ ? status_slot::paused : 0U) |
+                                   (blocked_handoff_.fsm != nullptr ? status_slot::blocked : 0U);
+                status_slot_->flags.store(flags, std::memory_order_relaxed);
+            }
+        }
+
+        void publish_status(const event_id_type event, const bool active) noexcept
+        {
+            status_draft_.event = detail::to_status_id(event);
+            publish_status(active);
+        }
+
+        void resume_sampled()
+        {
+            const auto transitions = transitions_made_;
+            const auto cpu_start = thread_cpu_time();
+            const auto start = latency_clock::now();
+            state_.resume();
+            const auto end = latency_clock::now();
+            const auto cpu_end = thread_cpu_time();
+
+            auto& statistics = *send_event_statistics_;
+            count(statistics.sampled);
+            statistics.wall_time.record(latency_clock::to_nanoseconds(end - start));
+            statistics.cpu_time.record(cpu_end - cpu_start);
+            statistics.transitions.record(transitions_made_ - transitions);
+        }
+
+        // It records the time since the current state was entered into 'histogram', which is created if needed.
+        void record_latency(latency_histogram*& histogram)
+        {
+            const auto now = latency_clock::now();
+            std::atomic_ref<latency_histogram*> edge {histogram};
+            auto* item = edge.load(std::memory_order_relaxed);
+            if (item == nullptr) [[unlikely]]
+            {
+                item = latency_histograms_.emplace_back(std::make_unique<latency_histogram>()).get();
+                edge.store(item, std::memory_order_release);
+            }
+
+            item->record(latency_clock::to_nanoseconds(now - entered_at_));
+            entered_at_ = now;
+        }
+
+        // It returns the block of edge statistics which holds 'edge' and the position of the edge in the block.
+        static std::pair<std::size_t, std::size_t> edge_position(const std::uint32_t edge) noexcept
+        {
+            const auto position = std::size_t(edge) + first_edge_block_size;
+            const auto block = std::size_t(std::bit_width(position) - std::bit_width(first_edge_block_size));
+            return {block, position - (first_edge_block_size << block)};
+        }
+
+        edge_statistics& edge_at(const std::uint32_t edge) const noexcept
+        {
+            const auto [block, offset] = edge_position(edge);
+            return edge_blocks_[block][offset];
+        }
+
+        // It allocates the statistics of a new edge of the transition map. It must be called under update_mutex_.
+        std::uint32_t new_edge()
+        {
+            if (edge_count_ == no_edge)
+            {
+                auto error_message = create_error_message();
+                error_message << "the transition table has too many transitions.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            const auto [block, offset] = edge_position(edge_count_);
+            if (!edge_blocks_[block])
+                edge_blocks_[block] = std::make_unique<edge_statistics[]>(first_edge_block_size << block);
+            return edge_count_++;
+        }
+
+        static void count(std::uint64_t& hits) noexcept
+        {
+            // Only the thread which runs the FSM increments the counter, so no read-modify-write is needed.
+            std::atomic_ref<std::uint64_t> counter {hits};
+            counter.store(counter.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        }
+
+        // Find the handle based on id. It returns an empty state handle if the id is not found.
+        state_handle_type find_handle(const state_id_type id) const
+        {
+            const auto index = find_index(id);
+            return index != npos ? states_[index].state.handle() : state_handle_type {};
+        }
+
+        // It returns true if the attached transition image (if any) has a transition for {from_state, on_event}-pair.
+        bool covered_by_image(const state_index_type from_state, const event_id_type on_event) const noexcept
+        {
+            if constexpr (supports_images)
+                return image_.target(from_state, detail::to_integer(on_event)) != transition_image::npos;
+            else
+                return false;
+        }
+
+        // Find the destination of {from_state, on_event}-pair, first in the transition image, then in the transition map.
+        std::optional<transition_target> find_target(const state_index_type from_state, const event_id_type on_event) const noexcept
+        {
+            if constexpr (supports_images)
+            {
+                const auto to_index = image_.target(from_state, detail::to_integer(on_event));
+                if (to_index != transition_image::npos)
+                    return transition_target {to_index, no_edge, const_cast<automaton*>(this)};
+            }
+
+            const epoch_guard guard {};
+            const auto& transitions = transitions_.load(std::memory_order_acquire)->map;
+            const auto it = transitions.find({from_state, on_event});
+            if (it != transitions.end())
+                return it->second;
+            return {};
+        }
+
+        logger_functor logger_ {};       // Callback for debugging and writing log. It is called when the state of
+                                         // the fsm whose id is in the first argument is about to change from 'from_state' to 'to_state'
+                                         // because the from_state is sending event 'on_event'.
+        // Published version of the transition table.
+        struct transition_table
+        {
+            transition_map map {};
+            std::uint64_t version {};
+        };
+
+        // Transition table in format {from-state, event} -> to-state. That is, an event sent from from-state will be routed to to-state.
+        std::atomic<transition_table*> transitions_ {new transition_table {}};
+        std::mutex update_mutex_ {};     // It serializes the changes of the transition table.
+        // Statistics of the transitions: block k holds first_edge_block_size << k edges. The blocks never move, so they
+        // are read without locks while edges are added.
+        std::array<std::unique_ptr<edge_statistics[]>, 27U> edge_blocks_ {};
+        std::uint32_t edge_count_ {};    // Number of edges allocated by new_edge (guarded by update_mutex_).
+        bool live_updates_ {};           // True if apply() may be called while the FSM runs (see set_live_updates).
+        std::vector<state_slot> states_; // All coroutines which represent the states in the state machine.
+        std::unordered_map<state_id_type, std::size_t> state_indices_; // State id -> index in states_.
+        std::vector<state_factory> factories_;                         // Factories of lazy states.
+        std::vector<automaton*> referrers_ {}; // FSMs which have transitions into this FSM (see relayout).
+        std::mutex referrers_mutex_ {};        // It protects referrers_.
+        target_counts targets_ {};             // It is protected by update_mutex_.
+        std::size_t materialized_count_ {}; // Number of states whose coroutines exist.
+        std::size_t resident_frame_bytes_ {}; // Total size of the coroutine frames which exist.
+        eviction_policy eviction_ {};         // Eviction of idle lazy states.
+        std::uint64_t eviction_count_ {};     // Number of evicted frames.
+        std::uint32_t lru_head_ {no_state};   // Most recently entered resident lazy state.
+        std::uint32_t lru_tail_ {no_state};   // Least recently entered resident lazy state.
+        transition_image image_ {};         // Attached transition image (optional).
+        std::unique_ptr<std::uint64_t[]> image_hits_ {}; // Hit counters of the transitions of the image.
+        bool count_transitions_ {};         // True if the transitions are counted.
+        std::unique_ptr<latency_histogram*[]> image_latency_ {};      // Latency histograms of the transitions of the image.
+        std::vector<std::unique_ptr<latency_histogram>> latency_histograms_ {}; // Latency histograms of all edges.
+        latency_clock::ticks entered_at_ {}; // Time when the current state was entered.
+        bool measure_latency_ {};           // True if the latency histograms are enabled.
+        std::uint64_t transitions_made_ {}; // Number of transitions made by this FSM.
+        // Number of emitted events which have had no transition. Only the thread which runs the FSM writes it.
+        std::atomic<std::uint64_t> missing_transitions_ {};
+        missing_transition_policy missing_transition_policy_ {}; // Reaction to a missing transition.
+        std::uint32_t sample_period_ {};    // Every sample_period_-th send_event call is measured (zero: none).
+        std::uint32_t sample_countdown_ {}; // Number of send_event calls until the next measured one.
+        std::unique_ptr<send_event_statistics> send_event_statistics_ {}; // Statistics of the measured send_event calls.
+        trace_recorder* tracer_ {};         // Recorder of the timeline (optional).
+        std::uint64_t budget_ {};           // Transitions allowed per send_event or resume call plus one (zero: no limit).
+        std::uint64_t budget_left_ {};      // Transitions left until the FSM pauses plus one (zero: no limit).
+        bool is_paused_ {};                 // True if the FSM has paused on an exhausted budget or a full channel.
+        transition_target blocked_handoff_ {}; // Target of the handoff which waits for room in its channel (see is_blocked).
+        bool publish_status_ {};            // True if the status is enabled or exported.
+        bool status_enabled_ {};            // True if the status is enabled (see enable_status).
+        status_slot* status_slot_ {};       // Slot of the exported status (see set_status_slot).
+        channel_type* channel_ {};          // Channel of the events handed off to the FSM (see set_channel).
+        status_type status_draft_ {};       // Latest status written (it is read only by the thread which runs the FSM).
+        seqlock<status_type> status_ {};    // Status read by the other threads.
         event_type event_;               // The latest event.
         state_handle_type state_ {};     // Current state (for information only).
         id_type id_;                     // Id of the FSM (for information only).
         std::atomic_bool is_active_ {};  // True if the FSM is running, false if suspended.
+        std::atomic<std::uint32_t> waiters_ {}; // Threads and coroutines which wait for the suspension (see wait_idle).
+        std::mutex waiter_mutex_ {};            // It protects the awaiting coroutines and the condition.
+        std::condition_variable waiter_condition_ {}; // Condition of the timed waiters.
+        idle_awaitable* idle_awaiters_ {};      // Coroutines which await the suspension (see until_idle).
+        detail::deferred_task idle_task_ {};    // Resumption of the awaiting coroutines.
+        bool idle_task_queued_ {};
     };
 
     template <typename _FSM>
@@ -0,0 +1,150 @@
+#pragma once
+#ifndef PCH
+    #include <cassert>
+    #include <cstddef>
+    #include <cstdint>
+    #include <span>
+    #include <type_traits>
+    #include <utility>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__)
+    #define CO_FSM_ASAN 1
+#elif defined(__has_feature)
+    #if __has_feature(address_sanitizer)
+        #define CO_FSM_ASAN 1
+    #endif
+#endif
+
+#if defined(CO_FSM_ASAN)
+    #include <sanitizer/asan_interface.h>
+#endif
+
+namespace co_fsm
+{
+    // It tells the owner of a buffer (e.g. a receive ring) that a segment it lent to an event is not used any more.
+    // The cookie identifies the segment for the owner (e.g. its position in the ring). The release function is called by the
+    // thread which runs the FSM at that moment.
+    struct release_token
+    {
+        using function = void (*)(void* owner, std::uint64_t cookie) noexcept;
+
+        function release {};
+        void* owner {};
+        std::uint64_t cookie {};
+
+        // It makes a token which calls (owner.*_Release)(cookie), e.g. release_token::of<&receive_ring::release>(ring, position).
+        template <auto _Release, typename _Owner>
+        static release_token of(_Owner& owner, const std::uint64_t cookie) noexcept
+        {
+            return {[](void* const item, const std::uint64_t value) noexcept { (static_cast<_Owner*>(item)->*_Release)(value); }, &owner,
+                    cookie};
+        }
+    };
+
+    // Move-only payload which refers to a segment of a buffer owned by the caller instead of a copy of it, so the bytes
+    // received by the caller reach the states without being copied. The segment is released (see release_token) when the
+    // payload is destroyed, i.e. when the event is replaced, or when the FSM suspends (the automaton calls release_borrowed
+    // of its event, see releases_borrowed_payload).
+    // The states must not keep a pointer into the segment. Debug builds assert that the segment is not accessed through
+    // a payload which has released it; builds with AddressSanitizer also poison the segment when it is released, so an
+    // access through a pointer kept by a state is reported. The owner then calls reclaim() before it reuses the segment.
+    template <typename _Element = const std::byte>
+    class borrowed_span
+    {
+    public:
+        using element_type = _Element;
+
+        borrowed_span() noexcept = default;
+        borrowed_span(const std::span<_Element> segment, const release_token token) noexcept: segment_(segment), token_(token)
+        {
+            assert(token.release != nullptr && "The segment can't be released.");
+        }
+
+        borrowed_span(const borrowed_span&) = delete;
+        borrowed_span(borrowed_span&& other) noexcept:
+            segment_(std::exchange(other.segment_, {})),
+            token_(std::exchange(other.token_, {}))
+        {
+        }
+
+        ~borrowed_span() { release(); }
+
+        borrowed_span& operator= (const borrowed_span&) = delete;
+        borrowed_span& operator= (borrowed_span&& other) noexcept
+        {
+            if (&other != this)
+            {
+                release();
+                segment_ = std::exchange(other.segment_, {});
+                token_ = std::exchange(other.token_, {});
+            }
+
+            return *this;
+        }
+
+        // It returns the segment. The payload must hold it (i.e. it has not been released or moved).
+        std::span<_Element> get() const noexcept
+        {
+            assert(holds_segment() && "The segment has been released.");
+            return segment_;
+        }
+
+        _Element* data() const noexcept { return get().data(); }
+        std::size_t size() const noexcept { return get().size(); }
+        _Element& operator[] (const std::size_t index) const noexcept
+        {
+            assert(index < size());
+            return get()[index];
+        }
+
+        // It returns true if the payload holds a segment which has not been released.
+        bool holds_segment() const noexcept { return token_.release != nullptr; }
+
+        // It releases the segment now.
+        void release() noexcept
+        {
+            if (!holds_segment())
+                return;
+
+            const auto token = std::exchange(token_, {});
+            const auto segment = std::exchange(segment_, {});
+#if defined(CO_FSM_ASAN)
+            ASAN_POISON_MEMORY_REGION(segment.data(), segment.size_bytes());
+#else
+            static_cast<void>(segment);
+#endif
+            token.release(token.owner, token.cookie);
+        }
+
+        // The owner calls it before it reuses a released segment (it removes the poison of AddressSanitizer).
+        static void reclaim(const std::span<_Element> segment) noexcept
+        {
+#if defined(CO_FSM_ASAN)
+            ASAN_UNPOISON_MEMORY_REGION(segment.data(), segment.size_bytes());
+#else
+            static_cast<void>(segment);
+#endif
+        }
+
+    private:
+        std::span<_Element> segment_ {};
+        release_token token_ {};
+    };
+
+    template <typename _Type>
+    struct is_borrowed_span: std::false_type
+    {
+    };
+
+    template <typename _Element>
+    struct is_borrowed_span<borrowed_span<_Element>>: std::true_type
+    {
+    };
+
+    // It is true if the event releases the borrowed payloads it holds when release_borrowed() is called; the automaton calls
+    // it when the FSM suspends and keeps the rest of the event (see automaton::latest_event). inline_event implements it;
+    // an event which holds a borrowed_span as a member should implement it too.
+    template <typename _Event>
+    concept releases_borrowed_payload = requires(_Event& event) { event.release_borrowed(); };
+}
@@ -0,0 +1,201 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <atomic>
+    #include <cstdint>
+    #include <mutex>
+    #include <utility>
+    #include <vector>
+#endif
+
+namespace co_fsm
+{
+    // Epoch based reclamation of objects which are read by lock-free readers and replaced by writers (RCU).
+    // A reader announces the global epoch when it enters a read-side critical section (see epoch_guard) and leaves it
+    // quiescent when the section ends. A writer publishes a new version of an object, retires the old one and the old
+    // version is deleted only when every reader which might still see it has left its critical section.
+    class epoch_domain
+    {
+    public:
+        // The domain used by the automata. There is a single domain since the readers are registered per thread.
+        static epoch_domain& instance()
+        {
+            static epoch_domain domain {};
+            return domain;
+        }
+
+        epoch_domain(const epoch_domain&) = delete;
+        epoch_domain& operator= (const epoch_domain&) = delete;
+
+        ~epoch_domain()
+        {
+            for (const auto& item: retired_)
+                item.deleter(item.object);
+
+            for (auto* item = records_.load(std::memory_order_acquire); item != nullptr;)
+                delete std::exchange(item, item->next);
+        }
+
+        // It registers the calling thread as a reader. Otherwise the record of the thread is allocated when it enters its first
+        // read-side critical section (automaton::start calls it, so the first transitions don't allocate).
+        void register_thread() { static_cast<void>(thread_local_record()); }
+
+        // It enters a read-side critical section on the calling thread. Sections can be nested.
+        void enter() noexcept
+        {
+            auto& local = thread_local_record();
+            if (local.depth++ == 0U)
+            {
+                local.item->epoch.store(epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+                // The announcement must be visible before the protected objects are loaded.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        // It leaves the read-side critical section.
+        void leave() noexcept
+        {
+            auto& local = thread_local_record();
+            if (--local.depth == 0U)
+                local.item->epoch.store(quiescent, std::memory_order_release);
+        }
+
+        // It retires an object which has already been replaced by a new version.
+        // The object is deleted when no reader can see it any more.
+        template <typename _Object>
+        void retire(const _Object* const object)
+        {
+            if (object == nullptr)
+                return;
+
+            {
+                std::lock_guard lock {mutex_};
+                // Readers which announce a later epoch see the new version.
+                const auto epoch = epoch_.fetch_add(1U, std::memory_order_seq_cst);
+                retired_.push_back({const_cast<_Object*>(object), [](void* const item) { delete static_cast<_Object*>(item); }, epoch});
+            }
+
+            reclaim();
+        }
+
+        // It deletes the retired objects which can not be seen by any reader.
+        // It returns the number of objects which are still waiting for reclamation.
+        std::size_t reclaim()
+        {
+            // Objects retired before this point can't be seen by the readers which enter after the scan below.
+            auto oldest = epoch_.load(std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (auto* item = records_.load(std::memory_order_acquire); item != nullptr; item = item->next)
+                if (const auto epoch = item->epoch.load(std::memory_order_acquire); epoch != quiescent)
+                    oldest = std::min(oldest, epoch);
+
+            std::vector<retired_object> reclaimable {};
+            {
+                std::lock_guard lock {mutex_};
+                std::erase_if(retired_,
+                              [&](const retired_object& item)
+                              {
+                                  if (item.epoch < oldest)
+                                  {
+                                      reclaimable.push_back(item);
+                                      return true;
+                                  }
+
+                                  return false;
+                              });
+                for (const auto& item: reclaimable)
+                    item.deleter(item.object);
+                return retired_.size();
+            }
+        }
+
+    private:
+        epoch_domain() = default;
+
+        static inline constexpr auto quiescent = std::uint64_t(~0ULL);
+
+        struct record
+        {
+            std::atomic<std::uint64_t> epoch {quiescent}; // Epoch announced by the reader or quiescent.
+            std::atomic_bool in_use {true};               // False if the thread which owned the record has exited.
+            record* next {};
+        };
+
+        // Record of the calling thread. It is released for reuse when the thread exits.
+        struct local_record
+        {
+            record* item {};
+            std::uint32_t depth {}; // Nesting depth of the read-side critical sections.
+
+            ~local_record()
+            {
+                if (item != nullptr)
+                    item->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        struct retired_object
+        {
+            void* object;
+            void (*deleter)(void*);
+            std::uint64_t epoch;
+        };
+
+        local_record& thread_local_record()
+        {
+            static thread_local local_record local {};
+            if (local.item == nullptr) [[unlikely]]
+                local.item = acquire_record();
+            return local;
+        }
+
+        record* acquire_record()
+        {
+            for (auto* item = records_.load(std::memory_order_acquire); item != nullptr; item = item->next)
+            {
+                bool in_use = false;
+                if (!item->in_use.load(std::memory_order_relaxed) && item->in_use.compare_exchange_strong(in_use, true))
+                    return item;
+            }
+
+            auto* const item = new record {};
+            item->next = records_.load(std::memory_order_relaxed);
+            while (!records_.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+
+            return item;
+        }
+
+        std::atomic<std::uint64_t> epoch_ {};     // Global epoch.
+        std::atomic<record*> records_ {};         // Records of the reader threads.
+        std::mutex mutex_ {};                     // It protects the retired objects.
+        std::vector<retired_object> retired_ {};  // Objects waiting for reclamation.
+    };
+
+    // Read-side critical section of the epoch domain. A guard constructed with enabled == false does nothing, so the
+    // readers of objects which are never replaced concurrently don't pay for the fence of enter().
+    class epoch_guard
+    {
+    public:
+        epoch_guard() noexcept: epoch_guard(true) {}
+
+        explicit epoch_guard(const bool enabled) noexcept: enabled_(enabled)
+        {
+            if (enabled_)
+                epoch_domain::instance().enter();
+        }
+
+        epoch_guard(const epoch_guard&) = delete;
+        epoch_guard& operator= (const epoch_guard&) = delete;
+
+        ~epoch_guard()
+        {
+            if (enabled_)
+                epoch_domain::instance().leave();
+        }
+
+    private:
+        const bool enabled_;
+    };
+}
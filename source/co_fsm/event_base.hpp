@@ -1,10 +1,87 @@
 #pragma once
 #ifndef PCH
+    #include <cassert>
+    #include <concepts>
     #include <optional>
+    #include <type_traits>
+    #include <utility>
 #endif
 
 namespace co_fsm
 {
+    // Traits of event ids. If 'invalid' is defined, it is a value which is never used as an event id, so an event stores
+    // its id in the native width of the id type and an invalid event holds 'invalid'. Otherwise the id is stored
+    // as std::optional.
+    // The sentinel is reserved explicitly, never by the name of an enumerator: the traits are specialized, or a constexpr
+    // function co_fsm_invalid_event_id(id type) is declared next to the id type (it is found by argument-dependent lookup), e.g.
+    //   template <> struct co_fsm::event_id_traits<my_event_id> { static constexpr my_event_id invalid = my_event_id(0); };
+    //   constexpr my_event_id co_fsm_invalid_event_id(my_event_id) { return my_event_id::none; }
+    template <typename _Id>
+    struct event_id_traits
+    {
+    };
+
+    namespace detail
+    {
+        template <typename _Id>
+        concept has_invalid_event_id_function = requires(const _Id id) {
+            { co_fsm_invalid_event_id(id) } -> std::convertible_to<_Id>;
+        };
+    }
+
+    template <typename _Id>
+        requires detail::has_invalid_event_id_function<_Id>
+    struct event_id_traits<_Id>
+    {
+        static inline constexpr _Id invalid = co_fsm_invalid_event_id(_Id {});
+    };
+
+    // It is true if the event id type has an invalid value (see event_id_traits).
+    template <typename _Id>
+    concept has_invalid_event_id = requires {
+        { event_id_traits<_Id>::invalid } -> std::convertible_to<_Id>;
+    };
+
+    namespace detail
+    {
+        // Storage of an event id which may be unset.
+        template <typename _Id>
+        class event_id_storage
+        {
+        public:
+            bool has_value() const noexcept { return id_.has_value(); }
+            const _Id& value() const { return id_.value(); }
+            void set(const _Id id) noexcept { id_ = id; }
+            void reset() noexcept { id_.reset(); }
+            bool equals(const _Id& id) const noexcept { return id_ == id; }
+
+        private:
+            std::optional<_Id> id_ {};
+        };
+
+        // Storage of an event id whose type has an invalid value: a single compare tells whether it is set.
+        template <typename _Id>
+            requires has_invalid_event_id<_Id>
+        class event_id_storage<_Id>
+        {
+        public:
+            static inline constexpr _Id invalid = event_id_traits<_Id>::invalid;
+
+            bool has_value() const noexcept { return id_ != invalid; }
+            const _Id& value() const noexcept { return id_; }
+            void set(const _Id id) noexcept
+            {
+                assert(id != invalid && "The id is reserved as the invalid event id (see event_id_traits).");
+                id_ = id;
+            }
+            void reset() noexcept { id_ = invalid; }
+            bool equals(const _Id& id) const noexcept { return id_ == id; }
+
+        private:
+            _Id id_ {invalid};
+        };
+    }
+
     // Base class for event. The main feature of this class is event identification.
     // An event object is considered valid as long as his identifier is valid.
     // Since FSM is a template, it will require a single customized derived class from this class.
@@ -19,16 +96,19 @@ namespace co_fsm
 
         event_base() = default;
         event_base(const event_base&) = default;
-        event_base(event_base&& item) noexcept: id_(std::move(item.id_)) { item.invalidate(); }
+        event_base(event_base&& item) noexcept: id_(item.id_) { item.invalidate(); }
 
         // It returns true if the event is empty (i.e. name string is not set)
         bool is_valid() const noexcept { return id_.has_value(); }
 
         // It returns the event id.
+        // If the id type has an invalid value (see event_id_traits), the id of an invalid event is that value.
         id_type id() const noexcept { return id_.value(); }
 
         // It returns true if the name of the event == other
-        bool has_same_id(const optional_id_type id) const noexcept { return id_ == id; }
+        bool has_same_id(const id_type id) const noexcept { return id_.equals(id); }
+
+        bool has_same_id(const optional_id_type id) const noexcept { return id.has_value() ? has_same_id(*id) : !is_valid(); }
 
         // It invalidates the event (i.e. it invalidates the identifier).
         void invalidate() noexcept { id_.reset(); }
@@ -39,7 +119,7 @@ namespace co_fsm
         {
             if (&item != this)
             {
-                id_ = std::move(item.id_);
+                id_ = item.id_;
                 item.invalidate(); // Invalidation of source event.
             }
 
@@ -47,11 +127,11 @@ namespace co_fsm
         }
 
     protected:
-        void set_id(const id_type id) noexcept { id_ = id; }
+        void set_id(const id_type id) noexcept { id_.set(id); }
 
     private:
         // The event id. By default it is not set meaning the event is invalid.
-        optional_id_type id_ {};
+        detail::event_id_storage<id_type> id_ {};
     };
 
     // It returns true if the events have same id. Otherwise it returns false.
@@ -1,6 +1,24 @@
 #pragma once
 #ifndef PCH
+    #include <co_fsm/allocation_guard.hpp>
+    #include <co_fsm/asymmetric_fence.hpp>
     #include <co_fsm/automaton.hpp>
+    #include <co_fsm/borrowed_payload.hpp>
+    #include <co_fsm/epoch.hpp>
     #include <co_fsm/event_base.hpp>
+    #include <co_fsm/inline_event.hpp>
+    #include <co_fsm/latency.hpp>
+    #include <co_fsm/multicast.hpp>
+    #include <co_fsm/payload_pool.hpp>
+    #include <co_fsm/pipeline.hpp>
+    #include <co_fsm/probes.hpp>
+    #include <co_fsm/sharded_router.hpp>
+    #include <co_fsm/spsc_queue.hpp>
     #include <co_fsm/state.hpp>
+    #include <co_fsm/status.hpp>
+    #include <co_fsm/status_registry.hpp>
+    #include <co_fsm/thread_affinity.hpp>
+    #include <co_fsm/trace.hpp>
+    #include <co_fsm/transition_export.hpp>
+    #include <co_fsm/transition_image.hpp>
 #endif
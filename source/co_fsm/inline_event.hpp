@@ -0,0 +1,298 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/borrowed_payload.hpp>
+    #include <co_fsm/event_base.hpp>
+    #include <co_fsm/payload_pool.hpp>
+
+    #include <cassert>
+    #include <cstddef>
+    #include <cstring>
+    #include <type_traits>
+    #include <utility>
+#endif
+
+namespace co_fsm
+{
+    // It registers _Payload as the payload of the events with id _Id (see inline_event).
+    template <auto _Id, typename _Payload>
+    struct event_payload
+    {
+        static inline constexpr auto id = _Id;
+        using type = _Payload;
+    };
+
+    // It is true if an object of the type can be moved to another address by copying its bytes (and not destroying the source).
+    // It is true for trivially copyable types; it can be specialized for other types (e.g. types which own a pointer).
+    template <typename _Type>
+    struct is_trivially_relocatable: std::is_trivially_copyable<_Type>
+    {
+    };
+
+    template <typename _Type>
+    struct is_trivially_relocatable<pooled_ptr<_Type>>: std::true_type
+    {
+    };
+
+    template <>
+    struct is_trivially_relocatable<pooled_buffer>: std::true_type
+    {
+    };
+
+    template <typename _Element>
+    struct is_trivially_relocatable<borrowed_span<_Element>>: std::true_type
+    {
+    };
+
+    template <typename _Type>
+    struct is_trivially_relocatable<shared_payload<_Type>>: std::true_type
+    {
+    };
+
+    namespace detail
+    {
+        template <auto _Id, typename... _Payloads>
+        struct find_payload
+        {
+            using type = void;
+        };
+
+        template <auto _Id, typename _First, typename... _Rest>
+        struct find_payload<_Id, _First, _Rest...>
+        {
+            using type = std::conditional_t<_First::id == _Id, typename _First::type, typename find_payload<_Id, _Rest...>::type>;
+        };
+
+        template <typename _Id, typename... _Payloads>
+        constexpr bool unique_payload_ids() noexcept
+        {
+            constexpr _Id ids[] {_Id {}, _Payloads::id...};
+            for (std::size_t i = 1U; i < std::size(ids); ++i)
+                for (std::size_t j = i + 1U; j < std::size(ids); ++j)
+                    if (ids[i] == ids[j])
+                        return false;
+            return true;
+        }
+
+        // It returns true if the payload is stored in the buffer of an event.
+        template <typename _Payload, std::size_t _Capacity, std::size_t _Alignment>
+        constexpr bool is_stored_inline() noexcept
+        {
+            if constexpr (std::is_void_v<_Payload>)
+                return true;
+            else
+                return sizeof(_Payload) <= _Capacity && alignof(_Payload) <= _Alignment &&
+                       (is_trivially_relocatable<_Payload>::value || std::is_nothrow_move_constructible_v<_Payload>);
+        }
+
+        // Operations on a payload of an event; a null function means that copying the bytes, respectively nothing, is enough.
+        struct payload_operations
+        {
+            void (*relocate)(void* to, void* from) noexcept;
+            void (*destroy)(void* payload) noexcept;
+        };
+    }
+
+    // Event whose payload is stored in the event object (small buffer) instead of a std::variant of all payload types.
+    // Every event id has at most one payload type which is registered at compile time by event_payload, e.g.
+    //
+    //   using event = co_fsm::inline_event<event_id, co_fsm::event_payload<event_id::hand_over, std::stop_token>,
+    //                                                co_fsm::event_payload<event_id::start_blink, std::uint16_t>>;
+    //   event.emplace<event_id::start_blink>(250U);
+    //   std::uint16_t time = event.get<event_id::start_blink>(); // It asserts that the event id is start_blink.
+    //
+    // A payload of up to _Capacity bytes is stored inline; a larger one is allocated from payload_pool when it is emplaced
+    // and only its pointer is stored, so the buffer is recycled when the payload is destroyed. A move copies the bytes of
+    // the buffer if the payload is trivially relocatable (see is_trivially_relocatable) and calls the move constructor
+    // otherwise. The payload is destroyed when the event is invalidated, gets another payload or id, or is destroyed.
+    // The default capacity keeps the event within a cache line of 64 bytes.
+    template <typename _Id, std::size_t _Capacity, typename... _Payloads>
+    class basic_inline_event: public event_base<_Id>
+    {
+        static_assert(detail::unique_payload_ids<_Id, _Payloads...>(), "An event id has more than one payload type.");
+        static_assert((std::is_same_v<std::remove_cv_t<decltype(_Payloads::id)>, _Id> && ...),
+                      "The payload is registered for another id type.");
+
+    public:
+        using id_type = _Id;
+        static inline constexpr std::size_t capacity = _Capacity;
+        static inline constexpr std::size_t alignment = alignof(std::max_align_t);
+
+        // Payload type of the event id (void if the id has no payload).
+        template <id_type _Event_id>
+        using payload_type = typename detail::find_payload<_Event_id, _Payloads...>::type;
+
+        // It is true if the payload of the event id is stored inline.
+        template <id_type _Event_id>
+        static inline constexpr bool is_inline = detail::is_stored_inline<payload_type<_Event_id>, _Capacity, alignment>();
+
+        basic_inline_event() noexcept = default;
+        basic_inline_event(const basic_inline_event&) = delete;
+        basic_inline_event(basic_inline_event&& other) noexcept: event_base<_Id>(std::move(other)) { take(other); }
+        ~basic_inline_event() { release(); }
+
+        basic_inline_event& operator= (const basic_inline_event&) = delete;
+        basic_inline_event& operator= (basic_inline_event&& other) noexcept
+        {
+            if (&other != this)
+            {
+                release();
+                event_base<_Id>::operator= (std::move(other));
+                take(other);
+            }
+
+            return *this;
+        }
+
+        // It sets an event id which has no payload. The previous payload (if any) is destroyed.
+        void set_id(const id_type id) noexcept
+        {
+            assert(!has_payload_type(id) && "The event id has a payload; use emplace.");
+            release();
+            event_base<_Id>::set_id(id);
+        }
+
+        // It sets the event id and constructs its payload from 'args'. The previous payload (if any) is destroyed first.
+        template <id_type _Event_id, typename... _Args>
+        payload_type<_Event_id>& emplace(_Args&&... args)
+        {
+            using payload = payload_type<_Event_id>;
+            static_assert(!std::is_void_v<payload>, "The event id has no payload type.");
+
+            invalidate();
+            if constexpr (is_stored_inline<payload>())
+                ::new (static_cast<void*>(storage_)) payload(std::forward<_Args>(args)...);
+            else
+                ::new (static_cast<void*>(storage_)) pooled_ptr<payload>(make_pooled<payload>(std::forward<_Args>(args)...));
+
+            operations_ = &operations_of<payload>;
+            event_base<_Id>::set_id(_Event_id);
+            return get<_Event_id>();
+        }
+
+        // It returns the payload. The event id must be _Event_id.
+        template <id_type _Event_id>
+        payload_type<_Event_id>& get() noexcept
+        {
+            assert(this->has_same_id(_Event_id) && "The event has another id.");
+            return *payload_pointer<payload_type<_Event_id>>();
+        }
+
+        template <id_type _Event_id>
+        const payload_type<_Event_id>& get() const noexcept
+        {
+            assert(this->has_same_id(_Event_id) && "The event has another id.");
+            return *const_cast<basic_inline_event*>(this)->template payload_pointer<payload_type<_Event_id>>();
+        }
+
+        // It returns the payload if the event id is _Event_id. Otherwise it returns null.
+        template <id_type _Event_id>
+        payload_type<_Event_id>* get_if() noexcept
+        {
+            return this->has_same_id(_Event_id) ? payload_pointer<payload_type<_Event_id>>() : nullptr;
+        }
+
+        template <id_type _Event_id>
+        const payload_type<_Event_id>* get_if() const noexcept
+        {
+            return const_cast<basic_inline_event*>(this)->template get_if<_Event_id>();
+        }
+
+        // It invalidates the event and destroys its payload.
+        void invalidate() noexcept
+        {
+            release();
+            event_base<_Id>::invalidate();
+        }
+
+        // It destroys the payload if it is a borrowed_span, so the segment goes back to its owner. The id is kept.
+        void release_borrowed() noexcept
+        {
+            if ((holds_borrowed<typename _Payloads::type>() || ...))
+                release();
+        }
+
+    private:
+        template <typename _Payload>
+        static constexpr bool is_stored_inline() noexcept
+        {
+            return detail::is_stored_inline<_Payload, _Capacity, alignment>();
+        }
+
+        // Type of the object in the buffer: the payload or the pointer to the pooled payload.
+        template <typename _Payload>
+        using stored_type = std::conditional_t<is_stored_inline<_Payload>(), _Payload, pooled_ptr<_Payload>>;
+
+        template <typename _Stored>
+        static void relocate(void* const to, void* const from) noexcept
+        {
+            auto* const source = std::launder(static_cast<_Stored*>(from));
+            ::new (to) _Stored(std::move(*source));
+            source->~_Stored();
+        }
+
+        template <typename _Stored>
+        static void destroy(void* const payload) noexcept
+        {
+            std::launder(static_cast<_Stored*>(payload))->~_Stored();
+        }
+
+        // An out-of-line payload is moved by copying its pointer.
+        template <typename _Payload, typename _Stored = stored_type<_Payload>>
+        static inline constexpr detail::payload_operations operations_of {
+            is_trivially_relocatable<_Stored>::value ? nullptr : &relocate<_Stored>,
+            std::is_trivially_destructible_v<_Stored> ? nullptr : &destroy<_Stored>,
+        };
+
+        static constexpr bool has_payload_type(const id_type id) noexcept { return ((_Payloads::id == id) || ...); }
+
+        template <typename _Payload>
+        bool holds_borrowed() const noexcept
+        {
+            if constexpr (is_borrowed_span<_Payload>::value)
+                return operations_ == &operations_of<_Payload>;
+            else
+                return false;
+        }
+
+        template <typename _Payload>
+        _Payload* payload_pointer() noexcept
+        {
+            static_assert(!std::is_void_v<_Payload>, "The event id has no payload type.");
+            assert(operations_ == &operations_of<_Payload> && "The event has no payload.");
+            if constexpr (is_stored_inline<_Payload>())
+                return std::launder(reinterpret_cast<_Payload*>(storage_));
+            else
+                return std::launder(reinterpret_cast<pooled_ptr<_Payload>*>(storage_))->get();
+        }
+
+        // It moves the payload of 'other' into this (empty) event.
+        void take(basic_inline_event& other) noexcept
+        {
+            operations_ = std::exchange(other.operations_, nullptr);
+            if (operations_ == nullptr)
+                return;
+
+            if (operations_->relocate == nullptr)
+                std::memcpy(storage_, other.storage_, _Capacity);
+            else
+                operations_->relocate(storage_, other.storage_);
+        }
+
+        void release() noexcept
+        {
+            if (operations_ != nullptr)
+            {
+                if (operations_->destroy != nullptr)
+                    operations_->destroy(storage_);
+                operations_ = nullptr;
+            }
+        }
+
+        const detail::payload_operations* operations_ {}; // Operations of the payload (null if the event has no payload).
+        alignas(alignment) std::byte storage_[_Capacity];
+    };
+
+    // Inline event of 64 bytes (a cache line) if event_base<_Id> takes at most 8 bytes (e.g. an enumeration id).
+    template <typename _Id, typename... _Payloads>
+    using inline_event = basic_inline_event<_Id, 64U - alignof(std::max_align_t), _Payloads...>;
+}
@@ -0,0 +1,222 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <array>
+    #include <atomic>
+    #include <bit>
+    #include <chrono>
+    #include <cmath>
+    #include <cstddef>
+    #include <cstdint>
+    #include <ctime>
+    #include <thread>
+
+    #if defined(__x86_64__) || defined(__i386__)
+        #if __has_include(<x86intrin.h>) && __has_include(<cpuid.h>)
+            #include <cpuid.h>
+            #include <x86intrin.h>
+            #define CO_FSM_HAS_RDTSC 1
+        #endif
+    #endif
+#endif
+
+#ifndef CO_FSM_HAS_RDTSC
+    #define CO_FSM_HAS_RDTSC 0
+#endif
+
+namespace co_fsm
+{
+    // Clock of the latency measurements. It reads the time stamp counter if the CPU has an invariant one
+    // (calibrated against std::chrono::steady_clock once per process) and std::chrono::steady_clock otherwise.
+    class latency_clock
+    {
+    public:
+        using ticks = std::uint64_t;
+
+        // It returns the current time in ticks.
+        static ticks now() noexcept
+        {
+#if CO_FSM_HAS_RDTSC
+            if (calibration().use_tsc) [[likely]]
+                return __rdtsc();
+#endif
+            return ticks(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        // It converts a number of ticks to nanoseconds.
+        static std::uint64_t to_nanoseconds(const ticks duration) noexcept
+        {
+            return std::uint64_t(double(duration) * calibration().nanoseconds_per_tick);
+        }
+
+        // It returns true if the time stamp counter is used.
+        static bool uses_tsc() noexcept { return calibration().use_tsc; }
+
+        // It calibrates the clock. It is called by the first measurement if not earlier, so it is worth calling it
+        // before the measurements start since it takes a few milliseconds.
+        static void calibrate() noexcept { static_cast<void>(calibration()); }
+
+    private:
+        struct calibration_data
+        {
+            bool use_tsc {};
+            double nanoseconds_per_tick {1.0};
+        };
+
+        static const calibration_data& calibration() noexcept
+        {
+            static const calibration_data data = []
+            {
+                calibration_data result {};
+#if CO_FSM_HAS_RDTSC
+                // Invariant TSC: CPUID.80000007H:EDX[8].
+                unsigned eax {}, ebx {}, ecx {}, edx {};
+                if (__get_cpuid(0x80000007U, &eax, &ebx, &ecx, &edx) != 0 && (edx & (1U << 8U)) != 0U)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    const auto start_ticks = __rdtsc();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    const auto end_ticks = __rdtsc();
+                    const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                    if (end_ticks > start_ticks)
+                    {
+                        result.use_tsc = true;
+                        result.nanoseconds_per_tick = elapsed / double(end_ticks - start_ticks);
+                    }
+                }
+#endif
+                return result;
+            }();
+            return data;
+        }
+    };
+
+    // CPU time of the calling thread in nanoseconds. If the platform has no per-thread CPU clock, the CPU time of the process is used.
+    inline std::uint64_t thread_cpu_time() noexcept
+    {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+        timespec time {};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return std::uint64_t(time.tv_sec) * 1000000000U + std::uint64_t(time.tv_nsec);
+#else
+        return std::uint64_t(double(std::clock()) * (1e9 / CLOCKS_PER_SEC));
+#endif
+    }
+
+    // Log-linear histogram of latencies in nanoseconds (in the style of HdrHistogram).
+    // Every power of two is split into sub_buckets linear buckets, so the relative error of a percentile is below
+    // 1 / sub_buckets (~3%). Values up to 2^max_magnitude ns (~68 s) are recorded, larger values in the last bucket.
+    // The histogram is written by one thread and can be read and merged by other threads at the same time without
+    // locks; the counters are accessed atomically with relaxed ordering.
+    class latency_histogram
+    {
+    public:
+        static inline constexpr unsigned sub_bucket_bits = 5U;
+        static inline constexpr unsigned sub_buckets = 1U << sub_bucket_bits;
+        static inline constexpr unsigned max_magnitude = 36U;
+        static inline constexpr std::size_t bucket_count = sub_buckets + (max_magnitude - sub_bucket_bits) * sub_buckets;
+
+        latency_histogram() noexcept = default;
+
+        // A copy is a snapshot of a histogram which may be written at the same time.
+        latency_histogram(const latency_histogram& other) noexcept
+        {
+            for (std::size_t i = 0U; i < bucket_count; ++i)
+                counts_[i] = other.count_at(i);
+        }
+
+        latency_histogram& operator= (const latency_histogram& other) noexcept
+        {
+            for (std::size_t i = 0U; i < bucket_count; ++i)
+                std::atomic_ref<std::uint64_t>(counts_[i]).store(other.count_at(i), std::memory_order_relaxed);
+            return *this;
+        }
+
+        // It records a latency. It is called by the thread which owns the histogram.
+        void record(const std::uint64_t nanoseconds) noexcept
+        {
+            std::atomic_ref<std::uint64_t> counter {counts_[bucket_index(nanoseconds)]};
+            counter.store(counter.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        }
+
+        // It adds the counts of 'other' to this histogram. It can be called by any number of threads at the same time.
+        latency_histogram& merge(const latency_histogram& other) noexcept
+        {
+            for (std::size_t i = 0U; i < bucket_count; ++i)
+                if (const auto count = other.count_at(i); count != 0U)
+                    std::atomic_ref<std::uint64_t>(counts_[i]).fetch_add(count, std::memory_order_relaxed);
+            return *this;
+        }
+
+        // It clears the histogram.
+        void reset() noexcept
+        {
+            for (auto& count: counts_)
+                std::atomic_ref<std::uint64_t>(count).store(0U, std::memory_order_relaxed);
+        }
+
+        // It returns the number of recorded latencies.
+        std::uint64_t count() const noexcept
+        {
+            std::uint64_t result {};
+            for (std::size_t i = 0U; i < bucket_count; ++i)
+                result += count_at(i);
+            return result;
+        }
+
+        // It returns the latency in nanoseconds below which 'percentile' percent of the recorded latencies are
+        // (i.e. the highest value equivalent to the bucket of the percentile). It returns zero if the histogram is empty.
+        std::uint64_t value_at_percentile(const double percentile) const noexcept
+        {
+            const auto total = count();
+            if (total == 0U)
+                return 0U;
+
+            const auto rank = std::max(std::uint64_t(1U), std::uint64_t(std::ceil(percentile / 100.0 * double(total))));
+            std::uint64_t seen {};
+            for (std::size_t i = 0U; i < bucket_count; ++i)
+                if ((seen += count_at(i)) >= rank)
+                    return highest_value(i);
+            return highest_value(bucket_count - 1U);
+        }
+
+        std::uint64_t p50() const noexcept { return value_at_percentile(50.0); }
+        std::uint64_t p99() const noexcept { return value_at_percentile(99.0); }
+        std::uint64_t p999() const noexcept { return value_at_percentile(99.9); }
+
+        // It returns the number of latencies recorded in the bucket at 'index'.
+        std::uint64_t count_at(const std::size_t index) const noexcept
+        {
+            return std::atomic_ref<std::uint64_t>(const_cast<std::uint64_t&>(counts_[index])).load(std::memory_order_relaxed);
+        }
+
+        // It returns the index of the bucket of the given latency.
+        static constexpr std::size_t bucket_index(const std::uint64_t nanoseconds) noexcept
+        {
+            if (nanoseconds < sub_buckets)
+                return std::size_t(nanoseconds);
+
+            // The highest bit selects the power of two, the next sub_bucket_bits bits select the linear bucket.
+            const auto magnitude = unsigned(std::bit_width(nanoseconds)) - 1U;
+            if (magnitude >= max_magnitude)
+                return bucket_count - 1U;
+
+            const auto shift = magnitude - sub_bucket_bits;
+            return sub_buckets + shift * sub_buckets + std::size_t((nanoseconds >> shift) - sub_buckets);
+        }
+
+        // It returns the highest latency recorded in the bucket at 'index'.
+        static constexpr std::uint64_t highest_value(const std::size_t index) noexcept
+        {
+            if (index < sub_buckets)
+                return index;
+
+            const auto shift = unsigned((index - sub_buckets) / sub_buckets);
+            const auto sub_bucket = std::uint64_t((index - sub_buckets) % sub_buckets + sub_buckets);
+            return ((sub_bucket + 1U) << shift) - 1U;
+        }
+
+    private:
+        std::array<std::uint64_t, bucket_count> counts_ {};
+    };
+}
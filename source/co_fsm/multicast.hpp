@@ -0,0 +1,227 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/epoch.hpp>
+    #include <co_fsm/payload_pool.hpp>
+    #include <co_fsm/thread_affinity.hpp>
+
+    #include <algorithm>
+    #include <atomic>
+    #include <condition_variable>
+    #include <cstddef>
+    #include <cstdint>
+    #include <deque>
+    #include <functional>
+    #include <memory>
+    #include <mutex>
+    #include <span>
+    #include <stdexcept>
+    #include <stop_token>
+    #include <thread>
+    #include <type_traits>
+    #include <utility>
+    #include <vector>
+#endif
+
+namespace co_fsm
+{
+    // Result of a multicast (see multicast_pool).
+    struct multicast_result
+    {
+        std::uint64_t delivered {};     // FSMs which have run the event until they suspended or paused.
+        std::uint64_t no_transition {}; // Delivered FSMs in which the event (or an event emitted for it) had no transition.
+        std::uint64_t errors {};        // FSMs whose event could not be made or whose send_event has thrown.
+    };
+
+    // Pool of threads which send an event to many FSMs (e.g. a configuration change or a shutdown notice to every
+    // session). The FSMs are partitioned into ranges of options::partition_size FSMs which the threads take one after
+    // another, so a thread runs neighbouring FSMs and a slow range doesn't hold the others up. The event of every FSM is
+    // made by the caller's function on the thread which runs the FSM; its payload should be a shared_payload, so the
+    // FSMs share one immutable object instead of a copy each.
+    // A notice is often handled by some states only, so the FSMs which receive multicasts should use the suspend policy of
+    // missing transitions, set when they are created (see automaton::set_missing_transition_policy): then a missing
+    // transition suspends the FSM in the state which has emitted the event and is counted as no_transition. Under the
+    // default throw_error policy it is counted as an error. The pool doesn't change the policy of the FSMs.
+    // The FSMs must not be run by other threads during the multicast.
+    class multicast_pool
+    {
+    public:
+        // It is called with the result when every FSM has received the event, on the thread which has run the last range.
+        using completion_handler = std::function<void(const multicast_result& result)>;
+
+        struct options
+        {
+            std::size_t thread_count {std::max(1U, std::thread::hardware_concurrency())};
+            std::size_t partition_size {256U}; // FSMs taken by a thread at once.
+            bool pin_threads {};               // Thread i runs on core i (if the platform supports it).
+        };
+
+        multicast_pool(): multicast_pool(options {}) {}
+
+        // It starts the threads.
+        explicit multicast_pool(const options& settings): settings_(settings)
+        {
+            if (settings_.thread_count == 0U)
+                throw std::runtime_error("A multicast pool needs a thread.");
+
+            settings_.partition_size = std::max(settings_.partition_size, std::size_t(1U));
+            for (std::size_t i = 0U; i < settings_.thread_count; ++i)
+            {
+                auto& thread = threads_.emplace_back([this](const std::stop_token stop) { run(stop); });
+                if (settings_.pin_threads)
+                    detail::pin_thread(thread, i);
+            }
+        }
+
+        multicast_pool(const multicast_pool&) = delete;
+        multicast_pool& operator= (const multicast_pool&) = delete;
+
+        // It finishes the multicasts which have been posted and stops the threads.
+        ~multicast_pool() { threads_.clear(); }
+
+        const options& get_options() const noexcept { return settings_; }
+
+        // It starts sending an event made by make_event() to every FSM and returns at once; on_complete is called when
+        // every FSM has received it. The FSMs and make_event must stay valid until then.
+        template <typename _Fsm, typename _Make_event>
+            requires std::is_invocable_r_v<typename _Fsm::event_type, _Make_event&>
+        void post(const std::span<_Fsm* const> fsms, _Make_event make_event, completion_handler on_complete)
+        {
+            if (fsms.empty())
+            {
+                if (on_complete)
+                    on_complete({});
+                return;
+            }
+
+            auto item = std::make_shared<job>();
+            item->size = fsms.size();
+            item->partitions_left.store((fsms.size() + settings_.partition_size - 1U) / settings_.partition_size,
+                                        std::memory_order_relaxed);
+            item->on_complete = std::move(on_complete);
+            item->send = [fsms, make_event = std::move(make_event)](const std::size_t begin, const std::size_t end) mutable
+            {
+                multicast_result result {};
+                for (std::size_t i = begin; i < end; ++i)
+                    deliver(*fsms[i], make_event, result);
+                return result;
+            };
+
+            {
+                const std::lock_guard lock {mutex_};
+                jobs_.push_back(std::move(item));
+            }
+            condition_.notify_all();
+        }
+
+        // It sends an event made by make_event() to every FSM and returns when every FSM has received it.
+        template <typename _Fsm, typename _Make_event>
+            requires std::is_invocable_r_v<typename _Fsm::event_type, _Make_event&>
+        multicast_result send(const std::span<_Fsm* const> fsms, _Make_event make_event)
+        {
+            // The flag is shared with the handler, since the thread which completes the multicast notifies it after
+            // this call may have returned.
+            multicast_result result {};
+            const auto done = std::make_shared<std::atomic_bool>();
+            post(fsms, std::move(make_event),
+                 [&result, done](const multicast_result& item)
+                 {
+                     result = item;
+                     done->store(true, std::memory_order_release);
+                     done->notify_one();
+                 });
+
+            done->wait(false, std::memory_order_acquire);
+            return result;
+        }
+
+        // It sends a copy of the event to every FSM (a copy of a shared_payload is a reference to the same object).
+        template <typename _Fsm>
+            requires std::is_copy_constructible_v<typename _Fsm::event_type>
+        multicast_result send(const std::span<_Fsm* const> fsms, const typename _Fsm::event_type& event)
+        {
+            return send(fsms, [&event] { return event; });
+        }
+
+    private:
+        // Multicast in progress: the threads take its ranges by incrementing 'next'.
+        struct job
+        {
+            std::function<multicast_result(std::size_t begin, std::size_t end)> send {};
+            completion_handler on_complete {};
+            std::size_t size {};
+            std::atomic<std::size_t> next {};
+            std::atomic<std::size_t> partitions_left {};
+            std::atomic<std::uint64_t> delivered {};
+            std::atomic<std::uint64_t> no_transition {};
+            std::atomic<std::uint64_t> errors {};
+        };
+
+        template <typename _Fsm, typename _Make_event>
+        static void deliver(_Fsm& fsm, _Make_event& make_event, multicast_result& result) noexcept
+        {
+            const auto missing = fsm.missing_transitions();
+            try
+            {
+                fsm.send_event(make_event());
+                ++result.delivered;
+                if (fsm.missing_transitions() != missing)
+                    ++result.no_transition;
+            }
+            catch (...)
+            {
+                ++result.errors;
+            }
+        }
+
+        void run(const std::stop_token stop)
+        {
+            epoch_domain::instance().register_thread();
+            payload_pool::instance().register_thread();
+            for (;;)
+            {
+                std::shared_ptr<job> item {};
+                {
+                    std::unique_lock lock {mutex_};
+                    if (!condition_.wait(lock, stop, [this] { return !jobs_.empty(); }))
+                        return; // Stop has been requested and the multicasts have been sent.
+                    item = jobs_.front();
+                }
+
+                work_on(*item);
+            }
+        }
+
+        // It sends the event to the ranges of the job which are left; the thread which takes the last range removes the job
+        // from the queue and the thread which finishes the last range completes it.
+        void work_on(job& item)
+        {
+            for (;;)
+            {
+                const auto begin = item.next.fetch_add(settings_.partition_size, std::memory_order_relaxed);
+                if (begin >= item.size)
+                    return;
+
+                const auto end = std::min(begin + settings_.partition_size, item.size);
+                if (end == item.size)
+                {
+                    const std::lock_guard lock {mutex_};
+                    jobs_.pop_front(); // Only the front job has ranges left.
+                }
+
+                const auto result = item.send(begin, end);
+                item.delivered.fetch_add(result.delivered, std::memory_order_relaxed);
+                item.no_transition.fetch_add(result.no_transition, std::memory_order_relaxed);
+                item.errors.fetch_add(result.errors, std::memory_order_relaxed);
+                if (item.partitions_left.fetch_sub(1U, std::memory_order_acq_rel) == 1U && item.on_complete)
+                    item.on_complete({item.delivered.load(std::memory_order_relaxed), item.no_transition.load(std::memory_order_relaxed),
+                                      item.errors.load(std::memory_order_relaxed)});
+            }
+        }
+
+        options settings_;
+        std::mutex mutex_ {};
+        std::condition_variable_any condition_ {};
+        std::deque<std::shared_ptr<job>> jobs_ {}; // Multicasts whose ranges have not all been taken.
+        std::vector<std::jthread> threads_ {};     // It is the last member, so the threads are joined first.
+    };
+}
@@ -0,0 +1,479 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <atomic>
+    #include <bit>
+    #include <cassert>
+    #include <cstddef>
+    #include <cstdint>
+    #include <new>
+    #include <span>
+    #include <type_traits>
+    #include <utility>
+#endif
+
+namespace co_fsm
+{
+    // Pool of buffers for the payloads of events (e.g. strings or frames of a few kilobytes), so sending an event with a
+    // large payload doesn't allocate once the pool is warm.
+    // The buffers are grouped in size classes of powers of two from min_block_size to max_block_size. Every thread has
+    // its own free list per size class, so allocation and deallocation on the same thread take no lock. A buffer freed by
+    // another thread (e.g. the event was handed over to an FSM running in another thread) is pushed to a lock-free list of
+    // the thread which allocated it; that thread takes the list back when its own free list of the size class is empty.
+    // A larger buffer than max_block_size is allocated and freed directly.
+    // The pool must outlive the buffers (see pooled_ptr and pooled_buffer).
+    class payload_pool
+    {
+    public:
+        static inline constexpr std::size_t min_block_size = 64U;
+        static inline constexpr std::size_t class_count = 11U;
+        static inline constexpr std::size_t max_block_size = min_block_size << (class_count - 1U); // 64 KiB
+        static inline constexpr std::size_t alignment = alignof(std::max_align_t);
+        // Free buffers of a size class kept by a thread; the surplus is returned to the system.
+        static inline constexpr std::size_t cached_bytes_per_class = 1U << 20U;
+
+        // The pool used by the events. There is a single pool since the free lists are per thread.
+        static payload_pool& instance()
+        {
+            static payload_pool pool {};
+            return pool;
+        }
+
+        payload_pool(const payload_pool&) = delete;
+        payload_pool& operator= (const payload_pool&) = delete;
+
+        ~payload_pool()
+        {
+            for (auto* item = caches_.load(std::memory_order_acquire); item != nullptr;)
+            {
+                auto* const next = item->next;
+                for (auto* free: item->free)
+                    free_list(free);
+                free_list(item->returned.load(std::memory_order_acquire));
+                delete item;
+                item = next;
+            }
+        }
+
+        // It returns a buffer of at least 'size' bytes aligned to 'alignment'.
+        void* allocate(const std::size_t size)
+        {
+            const auto index = size_class(size);
+            if (index == class_count)
+                return new_block(size, nullptr, index) + 1;
+
+            auto& local = thread_local_cache();
+            auto* item = pop(local.item, index);
+            if (item == nullptr)
+                item = new_block(block_size(index), local.item, index);
+            return item + 1;
+        }
+
+        // It returns the buffer to the pool. It may be called by any thread.
+        void deallocate(void* const buffer) noexcept
+        {
+            if (buffer == nullptr)
+                return;
+
+            auto* const item = static_cast<block*>(buffer) - 1;
+            if (item->owner == nullptr)
+                delete_block(item);
+            else if (auto* const local = thread_local_cache_if_any(); local == item->owner)
+                push(*local, item);
+            else
+            {
+                // The owner thread takes the buffer back when it needs one.
+                auto& returned = item->owner->returned;
+                item->next = returned.load(std::memory_order_relaxed);
+                while (!returned.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed))
+                {
+                }
+            }
+        }
+
+        // It allocates 'count' free buffers of at least 'size' bytes for the calling thread, so the next allocations don't
+        // allocate memory (e.g. before the FSM runs in a no_allocation_guard).
+        void reserve(const std::size_t size, const std::size_t count)
+        {
+            const auto index = size_class(size);
+            if (index == class_count)
+                return;
+
+            auto& local = thread_local_cache();
+            for (std::size_t i = 0U; i < count; ++i)
+                push(*local.item, new_block(block_size(index), local.item, index));
+        }
+
+        // It registers the calling thread. Otherwise its free lists are allocated when it allocates its first buffer
+        // (automaton::prepare_thread calls it).
+        void register_thread() { static_cast<void>(thread_local_cache()); }
+
+        // It returns the size of the buffers of the size class of 'size' (0 if the size is larger than max_block_size).
+        static constexpr std::size_t block_size_of(const std::size_t size) noexcept
+        {
+            const auto index = size_class(size);
+            return index == class_count ? 0U : block_size(index);
+        }
+
+    private:
+        payload_pool() = default;
+
+        struct cache;
+
+        // Header of a buffer.
+        struct alignas(alignment) block
+        {
+            cache* owner;        // Cache of the thread which allocated the block (null if the block is not pooled).
+            block* next;         // Next block of a free list.
+            std::size_t index;   // Size class.
+        };
+
+        // Free lists of a thread.
+        struct cache
+        {
+            block* free[class_count] {};
+            std::uint32_t free_count[class_count] {};
+            std::atomic<block*> returned {}; // Blocks freed by other threads.
+            std::atomic_bool in_use {true};  // False if the thread which owned the cache has exited.
+            cache* next {};
+        };
+
+        // Cache of the calling thread. It is released for reuse when the thread exits; its free blocks stay in it.
+        struct local_cache
+        {
+            cache* item {};
+
+            ~local_cache()
+            {
+                if (item != nullptr)
+                    item->in_use.store(false, std::memory_order_release);
+            }
+        };
+
+        static constexpr std::size_t size_class(const std::size_t size) noexcept
+        {
+            if (size <= min_block_size)
+                return 0U;
+            if (size > max_block_size)
+                return class_count;
+            return std::size_t(std::bit_width(size - 1U)) - std::size_t(std::countr_zero(min_block_size));
+        }
+
+        static constexpr std::size_t block_size(const std::size_t index) noexcept { return min_block_size << index; }
+
+        static constexpr std::uint32_t max_free_count(const std::size_t index) noexcept
+        {
+            return std::uint32_t(std::max<std::size_t>(cached_bytes_per_class / block_size(index), 1U));
+        }
+
+        static block* new_block(const std::size_t size, cache* const owner, const std::size_t index)
+        {
+            return ::new (::operator new (sizeof(block) + size)) block {owner, nullptr, index};
+        }
+
+        static void delete_block(block* const item) noexcept { ::operator delete (static_cast<void*>(item)); }
+
+        static void free_list(block* item) noexcept
+        {
+            while (item != nullptr)
+                delete_block(std::exchange(item, item->next));
+        }
+
+        static void push(cache& local, block* const item) noexcept
+        {
+            if (local.free_count[item->index] == max_free_count(item->index))
+            {
+                delete_block(item);
+                return;
+            }
+
+            item->next = std::exchange(local.free[item->index], item);
+            ++local.free_count[item->index];
+        }
+
+        static block* pop(cache* const local, const std::size_t index) noexcept
+        {
+            if (local->free[index] == nullptr)
+                for (auto* item = local->returned.exchange(nullptr, std::memory_order_acquire); item != nullptr;)
+                    push(*local, std::exchange(item, item->next));
+
+            auto* const item = local->free[index];
+            if (item != nullptr)
+            {
+                local->free[index] = item->next;
+                --local->free_count[index];
+            }
+
+            return item;
+        }
+
+        static local_cache& local_cache_storage() noexcept
+        {
+            static thread_local local_cache local {};
+            return local;
+        }
+
+        cache* thread_local_cache_if_any() noexcept { return local_cache_storage().item; }
+
+        local_cache& thread_local_cache()
+        {
+            auto& local = local_cache_storage();
+            if (local.item == nullptr) [[unlikely]]
+                local.item = acquire_cache();
+            return local;
+        }
+
+        cache* acquire_cache()
+        {
+            for (auto* item = caches_.load(std::memory_order_acquire); item != nullptr; item = item->next)
+            {
+                bool in_use = false;
+                if (!item->in_use.load(std::memory_order_relaxed) && item->in_use.compare_exchange_strong(in_use, true))
+                    return item;
+            }
+
+            auto* const item = new cache {};
+            item->next = caches_.load(std::memory_order_relaxed);
+            while (!caches_.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+
+            return item;
+        }
+
+        std::atomic<cache*> caches_ {}; // Caches of the threads.
+    };
+
+    // Move-only owner of an object allocated from the payload pool (a unique_ptr which returns the buffer to the pool).
+    // An event which holds it as payload recycles the buffer when the payload is destroyed, i.e. when the event is
+    // invalidated (inline_event) or overwritten.
+    template <typename _Type>
+    class pooled_ptr
+    {
+        static_assert(alignof(_Type) <= payload_pool::alignment, "The type is over-aligned for the payload pool.");
+
+    public:
+        using element_type = _Type;
+
+        pooled_ptr() noexcept = default;
+        pooled_ptr(const pooled_ptr&) = delete;
+        pooled_ptr(pooled_ptr&& other) noexcept: item_(std::exchange(other.item_, nullptr)) {}
+        ~pooled_ptr() { reset(); }
+
+        pooled_ptr& operator= (const pooled_ptr&) = delete;
+        pooled_ptr& operator= (pooled_ptr&& other) noexcept
+        {
+            if (&other != this)
+            {
+                reset();
+                item_ = std::exchange(other.item_, nullptr);
+            }
+
+            return *this;
+        }
+
+        // It constructs the object from 'args' in a pooled buffer.
+        template <typename... _Args>
+        static pooled_ptr make(_Args&&... args)
+        {
+            auto& pool = payload_pool::instance();
+            void* const buffer = pool.allocate(sizeof(_Type));
+            pooled_ptr result {};
+            try
+            {
+                result.item_ = ::new (buffer) _Type(std::forward<_Args>(args)...);
+            }
+            catch (...)
+            {
+                pool.deallocate(buffer);
+                throw;
+            }
+
+            return result;
+        }
+
+        _Type* get() const noexcept { return item_; }
+        _Type& operator* () const noexcept { return *item_; }
+        _Type* operator->() const noexcept { return item_; }
+        explicit operator bool () const noexcept { return item_ != nullptr; }
+
+        // It destroys the object and returns its buffer to the pool.
+        void reset() noexcept
+        {
+            if (item_ != nullptr)
+            {
+                auto* const item = std::exchange(item_, nullptr);
+                item->~_Type();
+                payload_pool::instance().deallocate(const_cast<std::remove_cv_t<_Type>*>(item));
+            }
+        }
+
+    private:
+        _Type* item_ {};
+    };
+
+    // It constructs an object in a pooled buffer.
+    template <typename _Type, typename... _Args>
+    pooled_ptr<_Type> make_pooled(_Args&&... args)
+    {
+        return pooled_ptr<_Type>::make(std::forward<_Args>(args)...);
+    }
+
+    // Move-only buffer of bytes allocated from the payload pool (e.g. a frame or a message).
+    class pooled_buffer
+    {
+    public:
+        pooled_buffer() noexcept = default;
+
+        // It allocates a buffer of 'size' bytes (the content is not initialized).
+        explicit pooled_buffer(const std::size_t size):
+            data_(size == 0U ? nullptr : static_cast<std::byte*>(payload_pool::instance().allocate(size))),
+            size_(size)
+        {
+        }
+
+        // It allocates a buffer and copies 'bytes' into it.
+        explicit pooled_buffer(const std::span<const std::byte> bytes): pooled_buffer(bytes.size())
+        {
+            std::copy(bytes.begin(), bytes.end(), data_);
+        }
+
+        pooled_buffer(const pooled_buffer&) = delete;
+        pooled_buffer(pooled_buffer&& other) noexcept: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0U)) {}
+        ~pooled_buffer() { reset(); }
+
+        pooled_buffer& operator= (const pooled_buffer&) = delete;
+        pooled_buffer& operator= (pooled_buffer&& other) noexcept
+        {
+            if (&other != this)
+            {
+                reset();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0U);
+            }
+
+            return *this;
+        }
+
+        std::byte* data() const noexcept { return data_; }
+        std::size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0U; }
+        std::span<std::byte> bytes() const noexcept { return {data_, size_}; }
+
+        // It returns the content as elements of a trivially copyable type, e.g. as<const char>() for a text.
+        template <typename _Type>
+        std::span<_Type> as() const noexcept
+        {
+            static_assert(std::is_trivially_copyable_v<_Type> && alignof(_Type) <= payload_pool::alignment);
+            return {reinterpret_cast<_Type*>(data_), size_ / sizeof(_Type)};
+        }
+
+        // It returns the buffer to the pool.
+        void reset() noexcept
+        {
+            payload_pool::instance().deallocate(std::exchange(data_, nullptr));
+            size_ = 0U;
+        }
+
+    private:
+        std::byte* data_ {};
+        std::size_t size_ {};
+    };
+
+    // Immutable object shared by the payloads of many events (e.g. a configuration sent to every session, see
+    // multicast_pool), so every event holds a pointer instead of a copy. The object and its reference count are
+    // allocated from the payload pool; a copy increments the count and the last owner destroys the object and returns
+    // the buffer to the pool. The owners may live on different threads.
+    template <typename _Type>
+    class shared_payload
+    {
+    public:
+        using element_type = const _Type;
+
+        shared_payload() noexcept = default;
+        shared_payload(const shared_payload& other) noexcept: item_(other.item_)
+        {
+            if (item_ != nullptr)
+                item_->references.fetch_add(1U, std::memory_order_relaxed);
+        }
+
+        shared_payload(shared_payload&& other) noexcept: item_(std::exchange(other.item_, nullptr)) {}
+        ~shared_payload() { reset(); }
+
+        shared_payload& operator= (const shared_payload& other) noexcept
+        {
+            shared_payload(other).swap(*this);
+            return *this;
+        }
+
+        shared_payload& operator= (shared_payload&& other) noexcept
+        {
+            shared_payload(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        // It constructs the object from 'args' in a pooled buffer.
+        template <typename... _Args>
+        static shared_payload make(_Args&&... args)
+        {
+            auto& pool = payload_pool::instance();
+            void* const buffer = pool.allocate(sizeof(shared_object));
+            shared_payload result {};
+            try
+            {
+                result.item_ = ::new (buffer) shared_object(std::forward<_Args>(args)...);
+            }
+            catch (...)
+            {
+                pool.deallocate(buffer);
+                throw;
+            }
+
+            return result;
+        }
+
+        const _Type* get() const noexcept { return item_ != nullptr ? &item_->value : nullptr; }
+        const _Type& operator* () const noexcept { return item_->value; }
+        const _Type* operator->() const noexcept { return &item_->value; }
+        explicit operator bool () const noexcept { return item_ != nullptr; }
+
+        // It returns the number of owners (it may be out of date when it is returned, if other threads own the object).
+        std::size_t use_count() const noexcept { return item_ != nullptr ? item_->references.load(std::memory_order_relaxed) : 0U; }
+
+        void swap(shared_payload& other) noexcept { std::swap(item_, other.item_); }
+
+        // It gives up the ownership; the last owner destroys the object and returns its buffer to the pool.
+        void reset() noexcept
+        {
+            auto* const item = std::exchange(item_, nullptr);
+            if (item != nullptr && item->references.fetch_sub(1U, std::memory_order_acq_rel) == 1U)
+            {
+                item->~shared_object();
+                payload_pool::instance().deallocate(item);
+            }
+        }
+
+    private:
+        struct shared_object
+        {
+            template <typename... _Args>
+            explicit shared_object(_Args&&... args): value(std::forward<_Args>(args)...)
+            {
+            }
+
+            std::atomic<std::size_t> references {1U};
+            const _Type value;
+        };
+
+        static_assert(alignof(shared_object) <= payload_pool::alignment, "The type is over-aligned for the payload pool.");
+
+        shared_object* item_ {};
+    };
+
+    // It constructs an object shared by the payloads of many events.
+    template <typename _Type, typename... _Args>
+    shared_payload<_Type> make_shared_payload(_Args&&... args)
+    {
+        return shared_payload<_Type>::make(std::forward<_Args>(args)...);
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/spsc_queue.hpp>
+    #include <co_fsm/thread_affinity.hpp>
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+    #include <exception>
+    #include <functional>
+    #include <optional>
+    #include <stop_token>
+    #include <thread>
+    #include <utility>
+#endif
+
+namespace co_fsm
+{
+    // Stage of a pipeline of FSMs: it runs an FSM on its own thread (optionally pinned to a core) and feeds it through
+    // a channel, i.e. an spsc_queue of the automaton (see automaton::set_channel). A transition of the previous stage into
+    // the FSM queues the event into the channel, so the previous stage goes on with its next event while this stage runs
+    // the current one; the thread of the stage drains the channel in batches. The stages are chained by the transition
+    // tables, as the FSMs of a single thread are (e.g. red -> green -> blue of example/rgb).
+    // The channel has a single producer: the thread of the previous stage, or a thread which calls send. The FSM must be
+    // started, and it must not be run by other threads while the stage exists. The stage polls its channel and backs off
+    // (spin, yield, then sleep) while it is empty. A transition budget of the FSM is kept: when the FSM pauses, the stage
+    // returns to its loop (e.g. to check for a stop request) and resumes the FSM before it takes the next events.
+    // When the channel of the next stage is full, the FSM pauses with the event of the handoff (see automaton::is_blocked)
+    // and the stage backs off and resumes it until the event is queued. The stages must form a chain or a DAG.
+    template <typename _Fsm>
+    class pipeline_stage
+    {
+    public:
+        using fsm_type = _Fsm;
+        using event_type = typename _Fsm::event_type;
+
+        // It is called on the thread of the stage when the FSM throws; then the stage drops the events it receives,
+        // since the FSM can't run again.
+        using error_handler = std::function<void(std::exception_ptr error)>;
+
+        struct options
+        {
+            std::size_t capacity {1024U};       // Events of the channel (rounded up to a power of two).
+            std::size_t batch_size {64U};       // Events taken from the channel at once.
+            std::optional<std::size_t> core {}; // The thread of the stage runs on this core (if the platform supports it).
+        };
+
+        // It attaches the channel to the FSM and starts the thread of the stage.
+        explicit pipeline_stage(_Fsm& fsm, const options& settings = {}, error_handler on_error = {}):
+            fsm_(fsm),
+            settings_(settings),
+            on_error_(std::move(on_error)),
+            channel_(settings.capacity)
+        {
+            settings_.batch_size = std::max(settings_.batch_size, std::size_t(1U));
+            fsm_.set_channel(&channel_);
+            thread_ = std::jthread([this](const std::stop_token stop) { run(stop); });
+            if (settings_.core)
+                detail::pin_thread(thread_, *settings_.core);
+        }
+
+        pipeline_stage(const pipeline_stage&) = delete;
+        pipeline_stage& operator= (const pipeline_stage&) = delete;
+
+        // It stops the thread and detaches the channel from the FSM.
+        ~pipeline_stage()
+        {
+            stop();
+            fsm_.set_channel(nullptr);
+        }
+
+        _Fsm& fsm() noexcept { return fsm_; }
+        const options& get_options() const noexcept { return settings_; }
+
+        // It queues the event for the current state of the FSM. It returns false (and doesn't move the event) if the
+        // channel is full. It must be called by the producer thread of the channel.
+        bool try_send(event_type&& event) { return channel_.try_emplace(_Fsm::npos, std::move(event)); }
+
+        // It queues the event for the current state of the FSM. It waits while the channel is full.
+        void send(event_type&& event)
+        {
+            for (std::uint32_t idle_rounds = 0U; !try_send(std::move(event));)
+                detail::idle_backoff(++idle_rounds);
+        }
+
+        // It waits until the stage has taken the events which have been queued so far. The latest event may still be running
+        // if the FSM has paused on its transition budget or a full channel, and the events which they hand off to the next
+        // stages may still be running; the stages are flushed in their order to wait for the whole pipeline.
+        void flush() const
+        {
+            for (std::uint32_t idle_rounds = 0U; !channel_.empty();)
+                detail::idle_backoff(++idle_rounds);
+        }
+
+        // It runs the events in the channel and stops the thread. The producer must have stopped sending.
+        void stop()
+        {
+            thread_.request_stop();
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        // Number of events run by the FSM. It can be called while the stage is running.
+        std::uint64_t events() const noexcept { return events_.load(std::memory_order_relaxed); }
+        // Number of batches taken from the channel.
+        std::uint64_t batches() const noexcept { return batches_.load(std::memory_order_relaxed); }
+        // Number of events dropped after the batch in which the FSM has thrown.
+        std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        static void add(std::atomic<std::uint64_t>& counter, const std::uint64_t value) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void run(const std::stop_token stop)
+        {
+            fsm_.prepare_thread();
+            bool failed {};
+            for (std::uint32_t idle_rounds = 0U;;)
+            {
+                bool taken {};
+                if (failed)
+                {
+                    const auto count = channel_.consume_batch([](typename _Fsm::channel_message&) noexcept {}, settings_.batch_size);
+                    add(dropped_, count);
+                    taken = count != 0U;
+                }
+                else
+                {
+                    try
+                    {
+                        // A paused FSM is resumed by drain_channel for another transition budget. A blocked FSM
+                        // which is still blocked has made no progress, so the stage backs off.
+                        const bool paused = fsm_.is_paused();
+                        const auto count = fsm_.drain_channel(settings_.batch_size);
+                        add(events_, count);
+                        taken = count != 0U || (paused && !fsm_.is_blocked());
+                    }
+                    catch (...)
+                    {
+                        failed = true;
+                        taken = true; // The rest of the batch has been dropped by drain_channel.
+                        if (on_error_)
+                        {
+                            try
+                            {
+                                on_error_(std::current_exception());
+                            }
+                            catch (...)
+                            {
+                            }
+                        }
+                    }
+                }
+
+                if (taken)
+                {
+                    add(batches_, 1U);
+                    idle_rounds = 0U;
+                }
+                else if (stop.stop_requested() && !fsm_.is_blocked())
+                    break; // The channel is empty and the producer has stopped.
+                else
+                    detail::idle_backoff(++idle_rounds);
+            }
+        }
+
+        _Fsm& fsm_;
+        options settings_;
+        error_handler on_error_;
+        typename _Fsm::channel_type channel_;
+        std::atomic<std::uint64_t> events_ {};
+        std::atomic<std::uint64_t> batches_ {};
+        std::atomic<std::uint64_t> dropped_ {};
+        std::jthread thread_ {}; // It is the last member, so it is joined before the other members are destroyed.
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/transition_image.hpp>
+
+    #include <cstdint>
+    #include <functional>
+    #include <type_traits>
+
+    #if defined(CO_FSM_ENABLE_PROBES) && __has_include(<sys/sdt.h>)
+        #include <sys/sdt.h>
+    #endif
+#endif
+
+// USDT (SystemTap/DTrace static) probes of provider 'co_fsm'. They are compiled in if CO_FSM_ENABLE_PROBES is defined
+// and <sys/sdt.h> is available (e.g. package systemtap-sdt-dev), and compiled out otherwise.
+// An enabled probe is a NOP until a tracer (bpftrace, perf, stap) attaches to it, for example:
+//   bpftrace -e 'usdt:./ring:co_fsm:transition { @[arg1, arg3] = count(); }'
+// The arguments are integers: integral and enumeration ids are converted to integers, other ids are hashed.
+//   transition(fsm, from_state, event, to_state)                transition within an FSM
+//   handoff(fsm, target_fsm, from_state, event, to_state)       transition into another FSM
+//   send_event(fsm, state, event)                               event injected by automaton::send_event
+//   start(fsm, state_count)                                     automaton::start
+//   pause(fsm, state)                                           the transition budget is exhausted before 'state' is resumed
+//   resume(fsm, state)                                          automaton::resume continues a paused FSM
+//   error(fsm, error, state, event)                             runtime error (see probe_error) before it is thrown
+#if defined(CO_FSM_ENABLE_PROBES) && defined(STAP_PROBEV)
+    #define CO_FSM_HAS_PROBES 1
+    #define CO_FSM_PROBE(name, ...) STAP_PROBEV(co_fsm, name, __VA_ARGS__)
+#else
+    #define CO_FSM_HAS_PROBES 0
+    #define CO_FSM_PROBE(name, ...) static_cast<void>(0)
+#endif
+
+namespace co_fsm
+{
+    namespace detail
+    {
+        // It converts an id to an integer for the probes and the traces. Ids which are not integral or enumerations are hashed.
+        template <typename _Id>
+        std::uint64_t to_trace_integer(const _Id& id) noexcept
+        {
+            if constexpr (std::is_integral_v<_Id> || std::is_enum_v<_Id>)
+                return to_integer(id);
+            else
+                return std::uint64_t(std::hash<_Id>()(id));
+        }
+    }
+
+    // Error codes of the 'error' probe.
+    enum class probe_error : unsigned
+    {
+        missing_transition = 1U, // No transition for {state, event}.
+        empty_event,             // An invalid event has been sent to a state.
+        not_started,             // send_event has been called before start.
+        invalid_state,           // A lazy state can't be created.
+        paused,                  // send_event has been called while the FSM is paused (see automaton::resume).
+    };
+}
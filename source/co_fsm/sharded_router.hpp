@@ -0,0 +1,258 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/epoch.hpp>
+    #include <co_fsm/payload_pool.hpp>
+    #include <co_fsm/spsc_queue.hpp>
+    #include <co_fsm/thread_affinity.hpp>
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+    #include <exception>
+    #include <functional>
+    #include <memory>
+    #include <stdexcept>
+    #include <stop_token>
+    #include <thread>
+    #include <unordered_map>
+    #include <utility>
+    #include <vector>
+#endif
+
+namespace co_fsm
+{
+    // Router of session-keyed events to FSMs partitioned across threads (shards) by the hash of the key.
+    // Every shard thread owns the FSMs of its sessions (one automaton per key, created by the session factory on the shard
+    // thread when the first event of the session arrives) and an spsc_queue per producer thread as its inbox. A producer
+    // sends an event with a single enqueue into the inbox of the shard of the key; the shard drains its inboxes in batches
+    // and calls send_event of the session. The FSMs are touched only by their shard thread, so they need no lock or atomic.
+    // Every producer (see producer_at) must be used by a single thread at a time. The sessions live until the router is
+    // destroyed. The shard threads poll their inboxes and back off (spin, yield, then sleep) while the inboxes are empty.
+    template <typename _Fsm, typename _Key, typename _Hash = std::hash<_Key>>
+    class sharded_router
+    {
+    public:
+        using fsm_type = _Fsm;
+        using key_type = _Key;
+        using event_type = typename _Fsm::event_type;
+
+        // It creates and starts the FSM of a session. It is called on the thread of the shard.
+        using session_factory = std::function<std::unique_ptr<_Fsm>(const _Key& key)>;
+        // It is called on the thread of the shard when the factory or send_event of a session throws; then the FSM of the
+        // session is destroyed.
+        using error_handler = std::function<void(const _Key& key, std::exception_ptr error)>;
+
+        struct options
+        {
+            std::size_t shard_count {std::max(1U, std::thread::hardware_concurrency())};
+            std::size_t producer_count {1U};
+            std::size_t inbox_capacity {1024U}; // Events per inbox (rounded up to a power of two).
+            std::size_t batch_size {64U};       // Events taken from an inbox at once.
+            bool pin_threads {};                // The thread of shard i runs on core i (if the platform supports it).
+        };
+
+        struct shard_statistics
+        {
+            std::uint64_t events {};   // Events processed.
+            std::uint64_t batches {};  // Batches taken from the inboxes.
+            std::uint64_t sessions {}; // Sessions created.
+            std::uint64_t errors {};   // Events whose factory or send_event has thrown.
+        };
+
+        // Sender of events of a producer thread.
+        class producer
+        {
+        public:
+            // It routes the event to the shard of the key. It returns false (and doesn't move the event) if the inbox is full.
+            bool try_send(const _Key& key, event_type&& event)
+            {
+                return router_->shards_[router_->shard_of(key)]->inboxes[index_]->try_emplace(key, std::move(event));
+            }
+
+            // It routes the event to the shard of the key. It waits while the inbox is full.
+            void send(const _Key& key, event_type&& event)
+            {
+                for (std::uint32_t idle_rounds = 0U; !try_send(key, std::move(event));)
+                    detail::idle_backoff(++idle_rounds);
+            }
+
+        private:
+            friend class sharded_router;
+
+            producer(sharded_router& router, const std::size_t index) noexcept: router_(&router), index_(index) {}
+
+            sharded_router* router_;
+            std::size_t index_;
+        };
+
+        // It starts the shard threads.
+        sharded_router(const options& settings, session_factory factory, error_handler on_error = {}):
+            settings_(settings),
+            factory_(std::move(factory)),
+            on_error_(std::move(on_error))
+        {
+            if (settings_.shard_count == 0U || settings_.producer_count == 0U || !factory_)
+                throw std::runtime_error("A sharded router needs a shard, a producer and a session factory.");
+
+            settings_.batch_size = std::max(settings_.batch_size, std::size_t(1U));
+            for (std::size_t i = 0U; i < settings_.shard_count; ++i)
+            {
+                auto& item = *shards_.emplace_back(std::make_unique<shard>());
+                for (std::size_t j = 0U; j < settings_.producer_count; ++j)
+                    item.inboxes.emplace_back(std::make_unique<inbox>(settings_.inbox_capacity));
+            }
+
+            for (std::size_t i = 0U; i < settings_.producer_count; ++i)
+                producers_.emplace_back(producer {*this, i});
+
+            for (std::size_t i = 0U; i < settings_.shard_count; ++i)
+            {
+                auto& item = *shards_[i];
+                item.thread = std::jthread([this, &item](const std::stop_token stop) { run(item, stop); });
+                if (settings_.pin_threads)
+                    detail::pin_thread(item.thread, i);
+            }
+        }
+
+        sharded_router(const sharded_router&) = delete;
+        sharded_router& operator= (const sharded_router&) = delete;
+
+        ~sharded_router() { stop(); }
+
+        const options& get_options() const noexcept { return settings_; }
+
+        // It returns the producer 'index' (less than options::producer_count).
+        producer& producer_at(const std::size_t index) noexcept { return producers_[index]; }
+
+        // It returns the shard of the key.
+        std::size_t shard_of(const _Key& key) const noexcept
+        {
+            // The hash is mixed, since std::hash of an integer is often the integer itself.
+            const auto hash = std::uint64_t(_Hash {}(key)) * 0x9E3779B97F4A7C15ULL;
+            return std::size_t((hash >> 32U) % settings_.shard_count);
+        }
+
+        // It waits until the shards have processed the events which have been sent so far.
+        void flush() const
+        {
+            for (const auto& item: shards_)
+                for (const auto& queue: item->inboxes)
+                    for (std::uint32_t idle_rounds = 0U; !queue->empty();)
+                        detail::idle_backoff(++idle_rounds);
+        }
+
+        // It processes the events in the inboxes and stops the shard threads. The producers must have stopped sending.
+        void stop()
+        {
+            for (auto& item: shards_)
+                item->thread.request_stop();
+            for (auto& item: shards_)
+                if (item->thread.joinable())
+                    item->thread.join();
+        }
+
+        // It returns the statistics of the shards. It can be called while the shards are running.
+        std::vector<shard_statistics> get_statistics() const
+        {
+            std::vector<shard_statistics> result {};
+            for (const auto& item: shards_)
+                result.push_back({item->events.load(std::memory_order_relaxed), item->batches.load(std::memory_order_relaxed),
+                                  item->sessions.load(std::memory_order_relaxed), item->errors.load(std::memory_order_relaxed)});
+            return result;
+        }
+
+    private:
+        struct message
+        {
+            _Key key;
+            event_type event;
+        };
+
+        using inbox = spsc_queue<message>;
+
+        // The counters are written only by the thread of the shard.
+        struct alignas(detail::cache_line_size) shard
+        {
+            std::vector<std::unique_ptr<inbox>> inboxes {}; // Inbox of every producer.
+            std::unordered_map<_Key, std::unique_ptr<_Fsm>, _Hash> sessions_by_key {};
+            std::atomic<std::uint64_t> events {};
+            std::atomic<std::uint64_t> batches {};
+            std::atomic<std::uint64_t> sessions {};
+            std::atomic<std::uint64_t> errors {};
+            std::jthread thread {};
+        };
+
+        static void add(std::atomic<std::uint64_t>& counter, const std::uint64_t value) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        void run(shard& self, const std::stop_token stop)
+        {
+            epoch_domain::instance().register_thread();
+            payload_pool::instance().register_thread();
+
+            const auto dispatch = [this, &self](message& item) noexcept { deliver(self, item); };
+            for (std::uint32_t idle_rounds = 0U;;)
+            {
+                std::size_t count {};
+                for (auto& queue: self.inboxes)
+                    if (const auto taken = queue->consume_batch(dispatch, settings_.batch_size); taken != 0U)
+                    {
+                        count += taken;
+                        add(self.batches, 1U);
+                    }
+
+                if (count != 0U)
+                {
+                    add(self.events, count);
+                    idle_rounds = 0U;
+                }
+                else if (stop.stop_requested())
+                    break; // The inboxes are empty and the producers have stopped.
+                else
+                    detail::idle_backoff(++idle_rounds);
+            }
+        }
+
+        void deliver(shard& self, message& item) noexcept
+        {
+            try
+            {
+                auto& session = self.sessions_by_key[item.key];
+                if (!session)
+                {
+                    session = factory_(item.key);
+                    if (!session)
+                        throw std::runtime_error("The session factory has not created an FSM.");
+                    add(self.sessions, 1U);
+                }
+
+                session->send_event(std::move(item.event));
+            }
+            catch (...)
+            {
+                // The FSM can't be resumed after an exception, so the next event of the session creates it again.
+                self.sessions_by_key.erase(item.key);
+                add(self.errors, 1U);
+                if (on_error_)
+                {
+                    try
+                    {
+                        on_error_(item.key, std::current_exception());
+                    }
+                    catch (...)
+                    {
+                    }
+                }
+            }
+        }
+
+        options settings_;
+        session_factory factory_;
+        error_handler on_error_;
+        std::vector<std::unique_ptr<shard>> shards_ {};
+        std::vector<producer> producers_ {};
+    };
+}
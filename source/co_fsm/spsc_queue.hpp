@@ -0,0 +1,181 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <atomic>
+    #include <bit>
+    #include <chrono>
+    #include <cstddef>
+    #include <cstdint>
+    #include <memory>
+    #include <new>
+    #include <thread>
+    #include <type_traits>
+    #include <utility>
+
+    #if defined(__x86_64__) || defined(__i386__)
+        #include <immintrin.h>
+    #endif
+#endif
+
+namespace co_fsm
+{
+    namespace detail
+    {
+        // Size of a cache line; the indices of a queue written by different threads are kept on different lines.
+        inline constexpr std::size_t cache_line_size = 64U;
+
+        // It tells the CPU that the thread is spinning.
+        inline void cpu_relax() noexcept
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+
+        // It waits a little longer after every idle round of a thread which polls queues: it spins, then yields, then sleeps.
+        inline void idle_backoff(const std::uint32_t idle_rounds) noexcept
+        {
+            if (idle_rounds < 64U)
+                cpu_relax();
+            else if (idle_rounds < 1024U)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    // Bounded queue of a single producer thread and a single consumer thread (a ring of a power of two slots).
+    // The producer and the consumer each own an index on their own cache line and keep a copy of the index of the other
+    // side, so they read the other cache line only when the ring looks full, respectively empty. The consumer takes the
+    // items in batches: it processes them in place and releases their slots with a single store, so a batch costs the
+    // producer one cache miss; after consume_batch returns, the items it has consumed have been processed.
+    template <typename _Item>
+    class spsc_queue
+    {
+    public:
+        using item_type = _Item;
+
+        // The capacity is rounded up to a power of two.
+        explicit spsc_queue(const std::size_t capacity):
+            mask_(std::bit_ceil(std::max(capacity, std::size_t(2U))) - 1U),
+            slots_(std::make_unique<slot[]>(mask_ + 1U))
+        {
+        }
+
+        spsc_queue(const spsc_queue&) = delete;
+        spsc_queue& operator= (const spsc_queue&) = delete;
+
+        ~spsc_queue()
+        {
+            const auto tail = producer_.index.load(std::memory_order_relaxed);
+            for (auto head = consumer_.index.load(std::memory_order_relaxed); head != tail; ++head)
+                item_at(head).~_Item();
+        }
+
+        std::size_t capacity() const noexcept { return mask_ + 1U; }
+
+        // It constructs an item from 'args' at the end of the queue. It returns false (and doesn't use 'args') if the
+        // queue is full. It must be called by the producer thread.
+        template <typename... _Args>
+        bool try_emplace(_Args&&... args)
+        {
+            const auto tail = producer_.index.load(std::memory_order_relaxed);
+            if (tail - producer_.other_index > mask_)
+            {
+                producer_.other_index = consumer_.index.load(std::memory_order_acquire);
+                if (tail - producer_.other_index > mask_)
+                    return false;
+            }
+
+            ::new (static_cast<void*>(slots_[tail & mask_].storage)) _Item(std::forward<_Args>(args)...);
+            producer_.index.store(tail + 1U, std::memory_order_release);
+            return true;
+        }
+
+        bool try_push(_Item&& item) { return try_emplace(std::move(item)); }
+
+        // It calls consume(item) for up to 'max_count' items from the front of the queue and then removes them.
+        // If consume returns bool, the batch ends after the item for which it returns false.
+        // It returns the number of items consumed. It must be called by the consumer thread.
+        template <typename _Consume>
+        std::size_t consume_batch(_Consume&& consume, const std::size_t max_count)
+        {
+            static_assert(std::is_nothrow_invocable_v<_Consume&, _Item&>, "The items of a batch are removed together.");
+
+            const auto head = consumer_.index.load(std::memory_order_relaxed);
+            if (consumer_.other_index == head)
+            {
+                consumer_.other_index = producer_.index.load(std::memory_order_acquire);
+                if (consumer_.other_index == head)
+                    return 0U;
+            }
+
+            auto count = std::size_t(std::min<std::uint64_t>(consumer_.other_index - head, max_count));
+            for (std::uint64_t i = head; i != head + count; ++i)
+            {
+                auto& item = item_at(i);
+                if constexpr (std::is_same_v<std::invoke_result_t<_Consume&, _Item&>, bool>)
+                {
+                    const bool more = consume(item);
+                    item.~_Item();
+                    if (!more)
+                    {
+                        count = std::size_t(i + 1U - head);
+                        break;
+                    }
+                }
+                else
+                {
+                    consume(item);
+                    item.~_Item();
+                }
+            }
+
+            consumer_.index.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        // It moves the front item into 'item'. It returns false if the queue is empty. It must be called by the consumer thread.
+        bool try_pop(_Item& item)
+        {
+            return consume_batch([&](_Item& front) noexcept { item = std::move(front); }, 1U) != 0U;
+        }
+
+        // It returns true if the queue is empty, i.e. the consumer has consumed every item pushed so far.
+        // It can be called by any thread.
+        bool empty() const noexcept
+        {
+            return consumer_.index.load(std::memory_order_acquire) == producer_.index.load(std::memory_order_acquire);
+        }
+
+        // It returns the number of items in the queue. It can be called by any thread.
+        std::size_t size() const noexcept
+        {
+            const auto head = consumer_.index.load(std::memory_order_acquire);
+            return std::size_t(producer_.index.load(std::memory_order_acquire) - head);
+        }
+
+    private:
+        struct slot
+        {
+            alignas(_Item) std::byte storage[sizeof(_Item)];
+        };
+
+        // Index of one side and its copy of the index of the other side.
+        struct alignas(detail::cache_line_size) side
+        {
+            std::atomic<std::uint64_t> index {};
+            std::uint64_t other_index {};
+        };
+
+        _Item& item_at(const std::uint64_t index) noexcept
+        {
+            return *std::launder(reinterpret_cast<_Item*>(slots_[index & mask_].storage));
+        }
+
+        side producer_ {}; // The tail: the index of the next item pushed.
+        side consumer_ {}; // The head: the index of the next item consumed.
+        const std::uint64_t mask_;
+        const std::unique_ptr<slot[]> slots_;
+    };
+}
@@ -1,7 +1,10 @@
 #pragma once
 #ifndef PCH
     #include <coroutine>
+    #include <cstddef>
     #include <sstream>
+    #include <stdexcept>
+    #include <utility>
 #endif
 
 namespace co_fsm
@@ -25,6 +28,15 @@ namespace co_fsm
                 void await_resume() noexcept { self->is_started = true; } // The state was resumed from initial_suspend
             };
 
+            // The coroutine frame is allocated through the promise so its size can be reported (see frame_size).
+            static void* operator new (const std::size_t size)
+            {
+                allocated_frame_size = size;
+                return ::operator new (size);
+            }
+
+            static void operator delete (void* const frame, const std::size_t size) noexcept { ::operator delete (frame, size); }
+
             initial_awaitable initial_suspend() noexcept { return {this}; }
             constexpr std::suspend_always final_suspend() noexcept { return {}; }
             state get_return_object() noexcept { return state(this); };
@@ -37,13 +49,21 @@ namespace co_fsm
                 throw std::runtime_error(error_message.str());
             }
 
+            // Size of the latest frame allocated by this thread. The promise is constructed right after its frame is allocated.
+            static inline thread_local std::size_t allocated_frame_size {};
+
             id_type id {};
+            std::size_t index {};                          // Index of the state in the FSM which owns it (set by automaton::add_state).
+            std::size_t frame_size {std::exchange(allocated_frame_size, 0U)}; // Size of the coroutine frame in bytes.
             bool is_started {}; // false if the state is waiting at initial_suspend, true if the state has been resumed from the
                                 // initial_suspend.
         };
 
         using handle_type = promise_type::handle_type;
 
+        // An empty state (i.e. without coroutine).
+        state() noexcept = default;
+
         // A state is move-only
         state(const state&) = delete;
         state(state&& other) noexcept: handle_(std::exchange(other.handle_, nullptr)) {}
@@ -67,6 +87,9 @@ namespace co_fsm
         // It returns true if the initial await has been resumed (typically by calling automaton::start()).
         bool is_started() const noexcept { return handle_.promise().is_started; }
 
+        // It returns the size of the coroutine frame in bytes.
+        std::size_t frame_size() const noexcept { return handle_.promise().frame_size; }
+
         // It returns the handle to the state coroutine.
         const handle_type& handle() const noexcept { return handle_; }
 
@@ -75,6 +98,8 @@ namespace co_fsm
         {
             if (&other != this)
             {
+                if (handle_)
+                    handle_.destroy();
                 handle_ = std::exchange(other.handle_, nullptr);
             }
 
@@ -87,6 +112,6 @@ namespace co_fsm
     private:
         explicit state(promise_type* promise) noexcept: handle_(handle_type::from_promise(*promise)) {}
 
-        handle_type handle_;
+        handle_type handle_ {};
     }; // State
 }
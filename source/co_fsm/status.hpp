@@ -0,0 +1,148 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/latency.hpp>
+    #include <co_fsm/probes.hpp>
+
+    #include <array>
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstring>
+    #include <type_traits>
+
+    #if defined(__x86_64__) || defined(__i386__)
+        #include <immintrin.h>
+    #endif
+#endif
+
+namespace co_fsm
+{
+    // Value written by a single thread and read by any number of threads without locks (sequence lock).
+    // The writer makes the sequence odd, writes the value and makes the sequence even again; a reader retries if the
+    // sequence was odd or has changed while it copied the value, so it always gets a consistent value and never blocks
+    // the writer. The value is kept in atomic words, so the concurrent copies are not data races.
+    template <typename _Value>
+        requires std::is_trivially_copyable_v<_Value> && std::is_default_constructible_v<_Value>
+    class seqlock
+    {
+    public:
+        // It stores the value. It must be called by one thread at a time.
+        void store(const _Value& value) noexcept
+        {
+            const auto sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1U, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release); // The odd sequence is visible before the value.
+
+            std::array<std::uint64_t, word_count> words {};
+            std::memcpy(words.data(), &value, sizeof(_Value));
+            for (std::size_t i = 0U; i < word_count; ++i)
+                words_[i].store(words[i], std::memory_order_relaxed);
+
+            sequence_.store(sequence + 2U, std::memory_order_release);
+        }
+
+        // It returns the latest value stored.
+        _Value load() const noexcept
+        {
+            std::array<std::uint64_t, word_count> words {};
+            for (;;)
+            {
+                const auto sequence = sequence_.load(std::memory_order_acquire);
+                if ((sequence & 1U) == 0U)
+                {
+                    for (std::size_t i = 0U; i < word_count; ++i)
+                        words[i] = words_[i].load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire); // The value is read before the sequence is checked.
+                    if (sequence_.load(std::memory_order_relaxed) == sequence)
+                        break;
+                }
+
+#if defined(__x86_64__) || defined(__i386__)
+                _mm_pause();
+#endif
+            }
+
+            _Value value {};
+            std::memcpy(static_cast<void*>(&value), words.data(), sizeof(_Value));
+            return value;
+        }
+
+        // It returns the number of stores made so far.
+        std::uint64_t version() const noexcept { return sequence_.load(std::memory_order_acquire) / 2U; }
+
+    private:
+        static inline constexpr std::size_t word_count = (sizeof(_Value) + sizeof(std::uint64_t) - 1U) / sizeof(std::uint64_t);
+
+        std::atomic<std::uint64_t> sequence_ {};
+        std::array<std::atomic<std::uint64_t>, word_count> words_ {};
+    };
+
+    namespace detail
+    {
+        // Type of an id in a status: the id itself if it can be copied by a seqlock, otherwise its hash (as in the probes).
+        template <typename _Id>
+        using status_id =
+            std::conditional_t<std::is_trivially_copyable_v<_Id> && std::is_default_constructible_v<_Id>, _Id, std::uint64_t>;
+
+        template <typename _Id>
+        status_id<_Id> to_status_id(const _Id& id) noexcept
+        {
+            if constexpr (std::is_same_v<status_id<_Id>, _Id>)
+                return id;
+            else
+                return to_trace_integer(id);
+        }
+    }
+
+    // Status of an FSM which other threads can read while the FSM runs (see automaton::enable_status).
+    template <typename _State_id, typename _Event_id>
+    struct automaton_status
+    {
+        detail::status_id<_State_id> state {}; // Current state.
+        detail::status_id<_Event_id> event {}; // Event of the latest transition (or of the latest send_event call).
+        bool is_active {};                     // True if the FSM is running, false if it is suspended or paused.
+        std::uint64_t transitions {};          // Number of transitions made by the FSM.
+        latency_clock::ticks timestamp {};     // Time when the FSM started running or stopped (see latency_clock).
+
+        // It returns the nanoseconds elapsed since the timestamp.
+        std::uint64_t age_in_nanoseconds() const noexcept
+        {
+            const auto now = latency_clock::now();
+            return now > timestamp ? latency_clock::to_nanoseconds(now - timestamp) : 0U;
+        }
+    };
+
+    // Status of an FSM in a shared memory segment, which other processes read (see status_registry and
+    // automaton::set_status_slot).
+    // Every field is written separately by a relaxed store, so a reader may see fields of slightly different moments.
+    // The ids are stored as integers (hashes for the ids which are not integral, as in the probes).
+    struct alignas(64) status_slot
+    {
+        static inline constexpr std::size_t name_size = 40U;
+
+        enum flag : std::uint32_t
+        {
+            in_use = 1U,   // The slot belongs to an FSM.
+            active = 2U,   // The FSM is running.
+            paused = 4U,   // The FSM has paused on an exhausted transition budget or a full channel.
+            reserved = 8U, // The slot is being given to an FSM.
+            blocked = 16U, // The FSM has paused since the channel of the FSM which it hands off to is full.
+        };
+
+        std::atomic<std::uint32_t> flags {};
+        std::atomic<std::uint32_t> generation {}; // It is incremented when the slot is given to another FSM.
+        std::atomic<std::uint64_t> fsm {};         // Id of the FSM.
+        std::atomic<std::uint64_t> state {};       // Current state.
+        std::atomic<std::uint64_t> event {};       // Event of the latest transition (or of the latest send_event call).
+        std::atomic<std::uint64_t> transitions {}; // Number of transitions made by the FSM.
+        std::atomic<std::uint64_t> errors {};      // Number of errors (e.g. missing transitions, see probe_error).
+        char name[name_size] {};                   // Name of the FSM (written before the slot is marked in use).
+
+        // It gives the slot back to its registry.
+        void release() noexcept { flags.store(0U, std::memory_order_release); }
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+                  "The status slots need lock-free atomics to be shared between processes.");
+    static_assert(sizeof(status_slot) == 128U);
+}
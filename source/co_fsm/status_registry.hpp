@@ -0,0 +1,314 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/probes.hpp>
+    #include <co_fsm/status.hpp>
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cerrno>
+    #include <cstddef>
+    #include <cstdint>
+    #include <memory>
+    #include <new>
+    #include <span>
+    #include <sstream>
+    #include <stdexcept>
+    #include <string>
+    #include <string_view>
+    #include <system_error>
+    #include <utility>
+
+    #if __has_include(<sys/mman.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>) && __has_include(<sys/stat.h>) && \
+        __has_include(<signal.h>)
+        #include <fcntl.h>
+        #include <signal.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #include <unistd.h>
+        #define CO_FSM_HAS_STATUS_REGISTRY 1
+    #endif
+#endif
+
+#ifndef CO_FSM_HAS_STATUS_REGISTRY
+    #define CO_FSM_HAS_STATUS_REGISTRY 0
+#endif
+
+// The status registry needs POSIX shared memory.
+#if CO_FSM_HAS_STATUS_REGISTRY
+namespace co_fsm
+{
+    namespace detail
+    {
+        // Header of the shared memory segment of a status registry; the slots follow it.
+        struct alignas(64) status_segment_header
+        {
+            static inline constexpr std::uint64_t signature = 0x3130'5453'4d53'4f43U; // "COSMST01"
+
+            std::atomic<std::uint64_t> magic {}; // It is written when the segment is initialized.
+            std::uint32_t slot_size {};
+            std::uint32_t capacity {};
+            std::atomic<std::uint32_t> used {}; // Number of slots which have been in use (the others are empty).
+            std::int32_t pid {};                // Process which has created the segment.
+        };
+
+        // It returns the POSIX name of a segment ("/name").
+        inline std::string segment_name(const std::string_view name)
+        {
+            return name.starts_with('/') ? std::string(name) : '/' + std::string(name);
+        }
+
+        [[noreturn]] inline void throw_segment_error(const std::string_view action, const std::string& name, const int error)
+        {
+            std::ostringstream error_message {};
+            error_message << "Shared memory segment '" << name << "' can't be " << action << ": " << std::generic_category().message(error)
+                          << '.';
+            throw std::runtime_error(error_message.str());
+        }
+
+        // Mapping of a segment.
+        class segment_mapping
+        {
+        public:
+            segment_mapping() noexcept = default;
+            segment_mapping(void* const address, const std::size_t size) noexcept: address_(address), size_(size) {}
+            segment_mapping(const segment_mapping&) = delete;
+            segment_mapping(segment_mapping&& other) noexcept:
+                address_(std::exchange(other.address_, nullptr)),
+                size_(std::exchange(other.size_, 0U))
+            {
+            }
+
+            ~segment_mapping()
+            {
+                if (address_ != nullptr)
+                    ::munmap(address_, size_);
+            }
+
+            segment_mapping& operator= (const segment_mapping&) = delete;
+            segment_mapping& operator= (segment_mapping&& other) noexcept
+            {
+                std::swap(address_, other.address_);
+                std::swap(size_, other.size_);
+                return *this;
+            }
+
+            void* address() const noexcept { return address_; }
+            std::size_t size() const noexcept { return size_; }
+
+        private:
+            void* address_ {};
+            std::size_t size_ {};
+        };
+
+        inline std::size_t segment_size(const std::uint32_t capacity) noexcept
+        {
+            return sizeof(status_segment_header) + std::size_t(capacity) * sizeof(status_slot);
+        }
+
+        // It returns if the process which has created the existing status registry segment 'name' has exited, so the segment
+        // can be replaced. Otherwise (the process runs, or the segment is not a status registry or can't be read) it throws.
+        inline void check_abandoned_segment(const std::string& name)
+        {
+            const int descriptor = ::shm_open(name.c_str(), O_RDONLY, 0);
+            if (descriptor < 0)
+                throw_segment_error("opened", name, errno);
+
+            struct stat information {};
+            void* address = MAP_FAILED;
+            if (::fstat(descriptor, &information) == 0 && std::size_t(information.st_size) >= sizeof(status_segment_header))
+                address = ::mmap(nullptr, sizeof(status_segment_header), PROT_READ, MAP_SHARED, descriptor, 0);
+            ::close(descriptor);
+            if (address == MAP_FAILED)
+                throw std::runtime_error("Shared memory segment '" + name + "' exists and is not a status registry.");
+
+            const segment_mapping mapping {address, sizeof(status_segment_header)};
+            const auto* const header = static_cast<const status_segment_header*>(address);
+            if (header->magic.load(std::memory_order_acquire) != status_segment_header::signature)
+                throw std::runtime_error("Shared memory segment '" + name + "' exists and is not a status registry.");
+
+            const auto pid = header->pid;
+            if (pid > 0 && ::kill(pid, 0) != 0 && errno == ESRCH)
+                return;
+
+            std::ostringstream error_message {};
+            error_message << "Shared memory segment '" << name << "' is used by the running process " << pid << '.';
+            throw std::runtime_error(error_message.str());
+        }
+    }
+
+    // Registry of the status of FSMs in a POSIX shared memory segment, so another process (e.g. the status-top tool)
+    // can inspect thousands of running FSMs without an RPC endpoint in the service. An FSM gets a slot by attach and writes
+    // its id, current state, latest event, active and paused flags, number of transitions and number of errors into it
+    // with relaxed stores (see status_slot). The slot is given back when the FSM is detached or destroyed. The registry
+    // creates the segment and removes it when it is destroyed; it must outlive the FSMs which use it. A segment with the
+    // same name is replaced only if the process which has created it has exited (e.g. crashed).
+    class status_registry
+    {
+    public:
+        // Permissions of the segment: the owner reads and writes it, its group reads it.
+        static inline constexpr ::mode_t default_mode = S_IRUSR | S_IWUSR | S_IRGRP;
+
+        // It creates the segment 'name' (e.g. "my_service") with room for 'capacity' FSMs and the permissions 'mode'.
+        // It throws if a process which is still running has a segment with the same name.
+        status_registry(const std::string_view name, const std::uint32_t capacity, const ::mode_t mode = default_mode):
+            name_(detail::segment_name(name))
+        {
+            int descriptor = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+            if (descriptor < 0 && errno == EEXIST)
+            {
+                detail::check_abandoned_segment(name_); // A segment left by a crashed process is replaced.
+                ::shm_unlink(name_.c_str());
+                descriptor = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+            }
+
+            if (descriptor < 0)
+                detail::throw_segment_error("created", name_, errno);
+
+            const auto size = detail::segment_size(capacity);
+            void* address = MAP_FAILED;
+            if (::ftruncate(descriptor, off_t(size)) == 0)
+                address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+            const int error = errno;
+            ::close(descriptor);
+            if (address == MAP_FAILED)
+            {
+                ::shm_unlink(name_.c_str());
+                detail::throw_segment_error("mapped", name_, error);
+            }
+
+            mapping_ = {address, size};
+            // The new segment is zeroed, so the slots are constructed empty.
+            header_ = ::new (address) detail::status_segment_header {};
+            auto* const slots = reinterpret_cast<status_slot*>(header_ + 1);
+            std::uninitialized_value_construct_n(slots, capacity);
+            slots_ = {slots, capacity};
+            header_->slot_size = sizeof(status_slot);
+            header_->capacity = capacity;
+            header_->pid = std::int32_t(::getpid());
+            header_->magic.store(detail::status_segment_header::signature, std::memory_order_release);
+        }
+
+        status_registry(const status_registry&) = delete;
+        status_registry& operator= (const status_registry&) = delete;
+
+        ~status_registry() { ::shm_unlink(name_.c_str()); }
+
+        const std::string& name() const noexcept { return name_; }
+        std::uint32_t capacity() const noexcept { return std::uint32_t(slots_.size()); }
+
+        // It gives a free slot to an FSM. It returns null if all slots are in use.
+        status_slot* acquire(const std::uint64_t fsm, const std::string_view name) noexcept
+        {
+            for (auto& slot: slots_)
+            {
+                // The slot is reserved; it is hidden from the readers until it is filled.
+                auto flags = slot.flags.load(std::memory_order_relaxed);
+                if (flags != 0U || !slot.flags.compare_exchange_strong(flags, status_slot::reserved, std::memory_order_acquire,
+                                                                        std::memory_order_relaxed))
+                    continue;
+
+                slot.generation.fetch_add(1U, std::memory_order_relaxed);
+                slot.fsm.store(fsm, std::memory_order_relaxed);
+                slot.state.store(0U, std::memory_order_relaxed);
+                slot.event.store(0U, std::memory_order_relaxed);
+                slot.transitions.store(0U, std::memory_order_relaxed);
+                slot.errors.store(0U, std::memory_order_relaxed);
+                const auto length = std::min(name.size(), status_slot::name_size - 1U);
+                std::copy_n(name.data(), length, slot.name);
+                std::fill(slot.name + length, slot.name + status_slot::name_size, '\0');
+                slot.flags.store(status_slot::in_use, std::memory_order_release);
+
+                const auto used = std::uint32_t(&slot - slots_.data()) + 1U;
+                for (auto count = header_->used.load(std::memory_order_relaxed);
+                     count < used && !header_->used.compare_exchange_weak(count, used, std::memory_order_release);)
+                {
+                }
+
+                return &slot;
+            }
+
+            return nullptr;
+        }
+
+        // It gives a slot to 'fsm' (see automaton::set_status_slot). It throws if all slots are in use.
+        template <typename _Fsm>
+        _Fsm& attach(_Fsm& fsm)
+        {
+            std::ostringstream name {};
+            name << fsm.id();
+            auto* const slot = acquire(detail::to_trace_integer(fsm.id()), name.str());
+            if (slot == nullptr)
+            {
+                std::ostringstream error_message {};
+                error_message << "FSM('" << fsm.id() << "'): The status can't be exported: the status registry '" << name_
+                              << "' is full (" << capacity() << " FSMs).";
+                throw std::runtime_error(error_message.str());
+            }
+
+            return fsm.set_status_slot(slot);
+        }
+
+        // It stops the export of the status of 'fsm' and gives its slot back.
+        template <typename _Fsm>
+        static _Fsm& detach(_Fsm& fsm) noexcept
+        {
+            return fsm.set_status_slot(nullptr);
+        }
+
+    private:
+        std::string name_;
+        detail::segment_mapping mapping_ {};
+        detail::status_segment_header* header_ {};
+        std::span<status_slot> slots_ {};
+    };
+
+    // Read-only view of the segment of a status registry created by another process.
+    class status_registry_view
+    {
+    public:
+        // It attaches to the segment 'name' read-only.
+        explicit status_registry_view(const std::string_view name): name_(detail::segment_name(name))
+        {
+            const int descriptor = ::shm_open(name_.c_str(), O_RDONLY, 0);
+            if (descriptor < 0)
+                detail::throw_segment_error("opened", name_, errno);
+
+            struct stat information {};
+            void* address = MAP_FAILED;
+            int error = EINVAL; // The segment is too small.
+            if (::fstat(descriptor, &information) != 0)
+                error = errno;
+            else if (std::size_t(information.st_size) >= sizeof(detail::status_segment_header))
+            {
+                address = ::mmap(nullptr, std::size_t(information.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+                error = errno;
+            }
+            ::close(descriptor);
+            if (address == MAP_FAILED)
+                detail::throw_segment_error("mapped", name_, error);
+
+            mapping_ = {address, std::size_t(information.st_size)};
+            header_ = static_cast<const detail::status_segment_header*>(address);
+            if (header_->magic.load(std::memory_order_acquire) != detail::status_segment_header::signature ||
+                header_->slot_size != sizeof(status_slot) || detail::segment_size(header_->capacity) > mapping_.size())
+                throw std::runtime_error("Shared memory segment '" + name_ + "' is not a status registry of this version.");
+            slots_ = {reinterpret_cast<const status_slot*>(header_ + 1), header_->capacity};
+        }
+
+        const std::string& name() const noexcept { return name_; }
+        std::int32_t pid() const noexcept { return header_->pid; }
+
+        // It returns the slots which have been in use so far; the readers check status_slot::in_use.
+        std::span<const status_slot> slots() const noexcept
+        {
+            return slots_.first(std::min<std::size_t>(header_->used.load(std::memory_order_acquire), slots_.size()));
+        }
+
+    private:
+        std::string name_;
+        detail::segment_mapping mapping_ {};
+        const detail::status_segment_header* header_ {};
+        std::span<const status_slot> slots_ {};
+    };
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <cstddef>
+    #include <thread>
+
+    #if defined(__linux__) && __has_include(<pthread.h>) && __has_include(<sched.h>)
+        #include <pthread.h>
+        #include <sched.h>
+        #define CO_FSM_HAS_THREAD_AFFINITY 1
+    #endif
+#endif
+
+#ifndef CO_FSM_HAS_THREAD_AFFINITY
+    #define CO_FSM_HAS_THREAD_AFFINITY 0
+#endif
+
+namespace co_fsm
+{
+    namespace detail
+    {
+        // It pins the thread to the core (if the platform supports it).
+        inline void pin_thread([[maybe_unused]] std::jthread& thread, [[maybe_unused]] const std::size_t core) noexcept
+        {
+#if CO_FSM_HAS_THREAD_AFFINITY
+            cpu_set_t cores;
+            CPU_ZERO(&cores);
+            CPU_SET(core % std::max(1U, std::thread::hardware_concurrency()), &cores);
+            ::pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores);
+#endif
+        }
+    }
+}
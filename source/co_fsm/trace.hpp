@@ -0,0 +1,337 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/latency.hpp>
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+    #include <iomanip>
+    #include <ios>
+    #include <map>
+    #include <memory>
+    #include <mutex>
+    #include <ostream>
+    #include <string>
+    #include <string_view>
+    #include <thread>
+    #include <utility>
+    #include <vector>
+#endif
+
+namespace co_fsm
+{
+    // Recorder of the timelines of FSMs (see automaton::set_trace_recorder) which can be written as a Chrome trace-event
+    // JSON file (chrome://tracing, https://ui.perfetto.dev). Every FSM is a track, every stay in a state is a slice and a
+    // transition into another FSM is a flow arrow between the tracks.
+    // The records are written into a lock-free buffer of the calling thread; a full buffer drops the new records instead of
+    // blocking. flush() moves the buffered records into the recorder and can be called from any thread (e.g. periodically
+    // from a background thread) while the FSMs are running.
+    class trace_recorder
+    {
+    public:
+        enum class record_type : std::uint8_t
+        {
+            enter,      // An event has been injected into the state (see automaton::send_event).
+            transition, // The state has emitted the event and the target state is entered.
+            suspend,    // The state has emitted an invalid event and the FSM suspends.
+            handoff,    // The state has emitted the event and it is queued into the channel of the target FSM, which
+                        // enters the target state on its own thread (an enter record of the target FSM).
+        };
+
+        struct record
+        {
+            latency_clock::ticks time;
+            std::uint64_t fsm;
+            std::uint64_t state;
+            std::uint64_t event;
+            std::uint64_t target_fsm;
+            std::uint64_t target_state;
+            record_type type;
+        };
+
+        // 'buffer_capacity' is the number of records buffered per thread between two flushes.
+        explicit trace_recorder(const std::size_t buffer_capacity = 1U << 16U):
+            capacity_(std::max(buffer_capacity, std::size_t(1U))),
+            generation_(next_generation().fetch_add(1U, std::memory_order_relaxed))
+        {
+            latency_clock::calibrate();
+        }
+
+        trace_recorder(const trace_recorder&) = delete;
+        trace_recorder& operator= (const trace_recorder&) = delete;
+
+        ~trace_recorder()
+        {
+            for (auto* item = buffers_.load(std::memory_order_acquire); item != nullptr;)
+                delete std::exchange(item, item->next);
+        }
+
+        void enter(const std::uint64_t fsm, const std::uint64_t state, const std::uint64_t event) noexcept
+        {
+            push({latency_clock::now(), fsm, state, event, fsm, state, record_type::enter});
+        }
+
+        void transition(const std::uint64_t fsm, const std::uint64_t from_state, const std::uint64_t event, const std::uint64_t target_fsm,
+                        const std::uint64_t to_state) noexcept
+        {
+            push({latency_clock::now(), fsm, from_state, event, target_fsm, to_state, record_type::transition});
+        }
+
+        void suspend(const std::uint64_t fsm, const std::uint64_t state) noexcept
+        {
+            push({latency_clock::now(), fsm, state, 0U, fsm, state, record_type::suspend});
+        }
+
+        void handoff(const std::uint64_t fsm, const std::uint64_t from_state, const std::uint64_t event, const std::uint64_t target_fsm,
+                     const std::uint64_t to_state) noexcept
+        {
+            push({latency_clock::now(), fsm, from_state, event, target_fsm, to_state, record_type::handoff});
+        }
+
+        // It allocates the buffer of the calling thread. Otherwise it is allocated when the thread records for the first time,
+        // which is an allocation inside a no_allocation_guard in trap mode, so a thread which records under the guard must
+        // call it first (automaton::prepare_thread does it). It throws std::bad_alloc if the buffer can't be allocated.
+        void register_thread() { static_cast<void>(local_buffer()); }
+
+        // It names the track of an FSM.
+        void name_fsm(const std::uint64_t fsm, std::string name)
+        {
+            std::lock_guard lock {mutex_};
+            fsm_names_[fsm] = std::move(name);
+        }
+
+        // It names a state of an FSM.
+        void name_state(const std::uint64_t fsm, const std::uint64_t state, std::string name)
+        {
+            std::lock_guard lock {mutex_};
+            state_names_[{fsm, state}] = std::move(name);
+        }
+
+        // It names an event.
+        void name_event(const std::uint64_t event, std::string name)
+        {
+            std::lock_guard lock {mutex_};
+            event_names_[event] = std::move(name);
+        }
+
+        // It moves the buffered records of all threads into the recorder. It returns the number of moved records.
+        std::size_t flush()
+        {
+            std::lock_guard lock {mutex_};
+            std::size_t count {};
+            for (auto* item = buffers_.load(std::memory_order_acquire); item != nullptr; item = item->next)
+            {
+                const auto tail = item->tail.load(std::memory_order_relaxed);
+                const auto head = item->head.load(std::memory_order_acquire);
+                for (auto i = tail; i != head; ++i)
+                    records_.push_back(item->records[i % capacity_]);
+                item->tail.store(head, std::memory_order_release);
+                count += head - tail;
+            }
+
+            return count;
+        }
+
+        // It returns the number of records which have been dropped since a buffer was full or could not be allocated.
+        std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+        // It flushes the buffers and writes all records as a Chrome trace-event JSON document.
+        void write_chrome_trace(std::ostream& out)
+        {
+            flush();
+            std::lock_guard lock {mutex_};
+            auto records = records_;
+            std::ranges::stable_sort(records, {}, &record::time);
+            const auto start = records.empty() ? latency_clock::ticks {} : records.front().time;
+
+            // The timestamps are in microseconds with a nanosecond resolution.
+            const auto flags = out.flags();
+            const auto precision = out.precision();
+            out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+            bool first = true;
+            const auto begin_event = [&](const char* const phase, const std::uint64_t fsm, const latency_clock::ticks time) -> std::ostream&
+            {
+                out << (first ? "" : ",\n") << "{\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << fsm
+                    << ",\"ts\":" << double(latency_clock::to_nanoseconds(time - start)) / 1000.0;
+                first = false;
+                return out;
+            };
+            const auto slice = [&](const char* const phase, const std::uint64_t fsm, const std::uint64_t state, const record& item)
+            {
+                begin_event(phase, fsm, item.time) << ",\"name\":";
+                write_name(out, state_names_, {fsm, state}, state);
+                if (phase[0] == 'B')
+                {
+                    out << ",\"args\":{\"event\":";
+                    write_name(out, event_names_, item.event, item.event);
+                    out << '}';
+                }
+
+                out << '}';
+            };
+
+            std::uint64_t flow_id {};
+            for (const auto& item: records)
+            {
+                switch (item.type)
+                {
+                    case record_type::enter:
+                        slice("B", item.fsm, item.state, item);
+                        break;
+                    case record_type::transition:
+                        if (item.target_fsm == item.fsm)
+                        {
+                            slice("E", item.fsm, item.state, item);
+                            slice("B", item.fsm, item.target_state, item);
+                            break;
+                        }
+
+                        // The flow starts in the slice of the source state and ends in the slice of the target state.
+                        ++flow_id;
+                        begin_event("s", item.fsm, item.time) << R"(,"name":"handoff","cat":"handoff","id":)" << flow_id << '}';
+                        slice("E", item.fsm, item.state, item);
+                        slice("B", item.target_fsm, item.target_state, item);
+                        begin_event("f", item.target_fsm, item.time)
+                            << R"(,"bp":"e","name":"handoff","cat":"handoff","id":)" << flow_id << '}';
+                        break;
+                    case record_type::suspend:
+                        slice("E", item.fsm, item.state, item);
+                        break;
+                    case record_type::handoff:
+                        // The target FSM opens its slice when it takes the event from its channel, so the flow ends in
+                        // the next slice of its track instead of opening one here.
+                        ++flow_id;
+                        begin_event("s", item.fsm, item.time) << R"(,"name":"handoff","cat":"handoff","id":)" << flow_id << '}';
+                        slice("E", item.fsm, item.state, item);
+                        begin_event("f", item.target_fsm, item.time) << R"(,"name":"handoff","cat":"handoff","id":)" << flow_id << '}';
+                        break;
+                }
+            }
+
+            for (const auto& [fsm, name]: fsm_names_)
+            {
+                out << (first ? "" : ",\n") << R"({"ph":"M","pid":1,"name":"thread_name","tid":)" << fsm << R"(,"args":{"name":)";
+                write_string(out, name);
+                out << "}}";
+                first = false;
+            }
+
+            out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+            out.flags(flags);
+            out.precision(precision);
+        }
+
+    private:
+        // Single producer (the owner thread), single consumer (flush) ring buffer.
+        struct buffer
+        {
+            explicit buffer(const std::size_t capacity): records(std::make_unique<record[]>(capacity)) {}
+
+            std::unique_ptr<record[]> records;
+            std::atomic<std::size_t> head {}; // Next record to write.
+            std::atomic<std::size_t> tail {}; // Next record to flush.
+            std::thread::id thread {std::this_thread::get_id()};
+            buffer* next {};
+        };
+
+        void push(const record& item) noexcept
+        {
+            buffer* local_item {};
+            try
+            {
+                local_item = &local_buffer();
+            }
+            catch (...)
+            {
+                // The first record of the thread could not allocate its buffer; the recording must not fail the FSM.
+                dropped_.fetch_add(1U, std::memory_order_relaxed);
+                return;
+            }
+
+            auto& local = *local_item;
+            const auto head = local.head.load(std::memory_order_relaxed);
+            if (head - local.tail.load(std::memory_order_acquire) == capacity_) [[unlikely]]
+            {
+                dropped_.fetch_add(1U, std::memory_order_relaxed);
+                return;
+            }
+
+            local.records[head % capacity_] = item;
+            local.head.store(head + 1U, std::memory_order_release);
+        }
+
+        // It returns the buffer of the calling thread. The buffer of the latest recorder used by the thread is cached.
+        buffer& local_buffer()
+        {
+            struct cache
+            {
+                std::uint64_t generation {~std::uint64_t {}};
+                buffer* item {};
+            };
+
+            static thread_local cache local {};
+            if (local.generation != generation_) [[unlikely]]
+                local = {generation_, &acquire_buffer()};
+            return *local.item;
+        }
+
+        buffer& acquire_buffer()
+        {
+            const auto thread = std::this_thread::get_id();
+            for (auto* item = buffers_.load(std::memory_order_acquire); item != nullptr; item = item->next)
+                if (item->thread == thread)
+                    return *item;
+
+            // Buffers are only added, so the list can be searched by flush while a buffer is added.
+            auto* const item = new buffer(capacity_);
+            item->next = buffers_.load(std::memory_order_relaxed);
+            while (!buffers_.compare_exchange_weak(item->next, item, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+
+            return *item;
+        }
+
+        template <typename _Key>
+        static void write_name(std::ostream& out, const std::map<_Key, std::string>& names, const _Key& key, const std::uint64_t id)
+        {
+            if (const auto it = names.find(key); it != names.end())
+                write_string(out, it->second);
+            else
+                out << '"' << id << '"';
+        }
+
+        static void write_string(std::ostream& out, const std::string_view text)
+        {
+            out << '"';
+            for (const char c: text)
+            {
+                if (c == '"' || c == '\\')
+                    out << '\\' << c;
+                else if (static_cast<unsigned char>(c) < 0x20U)
+                    out << ' ';
+                else
+                    out << c;
+            }
+
+            out << '"';
+        }
+
+        static std::atomic<std::uint64_t>& next_generation() noexcept
+        {
+            static std::atomic<std::uint64_t> generation {};
+            return generation;
+        }
+
+        const std::size_t capacity_;      // Number of records in a buffer.
+        const std::uint64_t generation_; // Unique id of the recorder (the address may be reused by another recorder).
+        std::atomic<buffer*> buffers_ {}; // Buffers of the threads which have recorded.
+        std::atomic<std::uint64_t> dropped_ {};
+        std::mutex mutex_ {}; // It protects the flushed records and the names.
+        std::vector<record> records_ {};
+        std::map<std::uint64_t, std::string> fsm_names_ {};
+        std::map<std::pair<std::uint64_t, std::uint64_t>, std::string> state_names_ {};
+        std::map<std::uint64_t, std::string> event_names_ {};
+    };
+}
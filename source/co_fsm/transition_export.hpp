@@ -0,0 +1,154 @@
+#pragma once
+#ifndef PCH
+    #include <co_fsm/latency.hpp>
+    #include <co_fsm/transition_image.hpp>
+
+    #include <algorithm>
+    #include <cmath>
+    #include <cstdint>
+    #include <istream>
+    #include <ostream>
+    #include <sstream>
+    #include <stdexcept>
+    #include <string>
+    #include <string_view>
+#endif
+
+namespace co_fsm
+{
+    // First line of a transition profile (see write_transition_profile).
+    inline constexpr const char* profile_signature = "co_fsm transition profile 1";
+
+    // It writes the transitions of 'fsm' and their hit counts (see automaton::enable_transition_counters) as CSV.
+    // Columns: fsm, from, event, to, target_fsm, count.
+    template <typename _Fsm>
+    void write_transition_counts_csv(const _Fsm& fsm, std::ostream& out)
+    {
+        out << "fsm,from,event,to,target_fsm,count\n";
+        for (const auto& [item, count]: fsm.get_transition_counts())
+        {
+            const auto* const target = item.target != nullptr ? item.target : &fsm;
+            out << fsm.id() << ',' << item.from << ',' << item.event << ',' << item.to << ',' << target->id() << ',' << count << '\n';
+        }
+    }
+
+    // It writes the transitions of 'fsm' as a Graphviz digraph whose edge thickness is proportional to the logarithm
+    // of the hit counts, so the hot paths stand out. States of other FSMs are prefixed with the id of their FSM.
+    template <typename _Fsm>
+    void write_transition_counts_graphviz(const _Fsm& fsm, std::ostream& out)
+    {
+        constexpr double min_pen_width = 0.5;
+        constexpr double max_pen_width = 8.0;
+
+        const auto counts = fsm.get_transition_counts();
+        std::uint64_t max_count {};
+        for (const auto& item: counts)
+            max_count = std::max(max_count, item.count);
+
+        const auto node = [&](const _Fsm* const owner, const auto state_id) -> std::ostream&
+        {
+            out << '"';
+            if (owner != &fsm)
+                out << owner->id() << ':';
+            return out << state_id << '"';
+        };
+
+        out << "digraph \"" << fsm.id() << "\" {\n";
+        for (const auto& [item, count]: counts)
+        {
+            const auto* const target = item.target != nullptr ? item.target : &fsm;
+            const double heat = max_count != 0U ? std::log1p(double(count)) / std::log1p(double(max_count)) : 0.0;
+            out << "  ";
+            node(&fsm, item.from) << " -> ";
+            node(target, item.to) << " [label=\"" << item.event << " (" << count
+                                  << ")\", penwidth=" << min_pen_width + heat * (max_pen_width - min_pen_width) << "];\n";
+        }
+
+        out << "}\n";
+    }
+
+    // It writes the non-empty buckets of a histogram as CSV rows "name,value,count", where value is the highest value of the bucket.
+    inline void write_histogram_csv(std::ostream& out, const std::string_view name, const latency_histogram& histogram)
+    {
+        for (std::size_t i = 0U; i < latency_histogram::bucket_count; ++i)
+            if (const auto count = histogram.count_at(i); count != 0U)
+                out << name << ',' << latency_histogram::highest_value(i) << ',' << count << '\n';
+    }
+
+    // It writes the latency histograms of the edges of 'fsm' (see automaton::enable_latency_histograms) as CSV.
+    // Columns: fsm, from, event, to, target_fsm, latency_ns, count.
+    template <typename _Fsm>
+    void write_latency_histograms_csv(const _Fsm& fsm, std::ostream& out)
+    {
+        out << "fsm,from,event,to,target_fsm,latency_ns,count\n";
+        for (const auto& [item, histogram]: fsm.get_latency_histograms())
+        {
+            const auto* const target = item.target != nullptr ? item.target : &fsm;
+            std::ostringstream edge {};
+            edge << fsm.id() << ',' << item.from << ',' << item.event << ',' << item.to << ',' << target->id();
+            write_histogram_csv(out, edge.str(), histogram);
+        }
+    }
+
+    // It writes the statistics of the sampled send_event calls of 'fsm' (see automaton::enable_send_event_sampling) as CSV.
+    // Columns: fsm, metric (wall_time_ns, cpu_time_ns or transitions), value, count.
+    template <typename _Fsm>
+    void write_send_event_statistics_csv(const _Fsm& fsm, std::ostream& out)
+    {
+        const auto statistics = fsm.get_send_event_statistics();
+        const auto prefix = [&](const char* const metric)
+        {
+            std::ostringstream name {};
+            name << fsm.id() << ',' << metric;
+            return name.str();
+        };
+
+        out << "fsm,metric,value,count\n";
+        write_histogram_csv(out, prefix("wall_time_ns"), statistics.wall_time);
+        write_histogram_csv(out, prefix("cpu_time_ns"), statistics.cpu_time);
+        write_histogram_csv(out, prefix("transitions"), statistics.transitions);
+    }
+
+    // It writes the hit counts of the transitions within 'fsm' as a profile which can be read by read_transition_profile
+    // (e.g. to relayout the FSM in a later run). The ids are written as integers, one "from event to count" line per transition.
+    // Transitions to other FSMs are not written.
+    template <typename _Fsm>
+    void write_transition_profile(const _Fsm& fsm, std::ostream& out)
+    {
+        out << profile_signature << '\n';
+        for (const auto& [item, count]: fsm.get_transition_counts())
+            if (item.target == nullptr || item.target == &fsm)
+                out << detail::to_integer(item.from) << ' ' << detail::to_integer(item.event) << ' ' << detail::to_integer(item.to) << ' '
+                    << count << '\n';
+    }
+
+    // It reads a profile written by write_transition_profile.
+    template <typename _Fsm>
+    typename _Fsm::transition_count::vector read_transition_profile(std::istream& in)
+    {
+        std::string signature {};
+        if (!std::getline(in, signature) || signature != profile_signature)
+            throw std::runtime_error("Transition profile has an invalid signature.");
+
+        using state_id_type = typename _Fsm::state_id_type;
+        using event_id_type = typename _Fsm::event_id_type;
+
+        typename _Fsm::transition_count::vector result {};
+        std::uint64_t from {}, event {}, to {}, count {};
+        while (in >> from >> event >> to >> count)
+        {
+            const typename _Fsm::transition item {detail::from_integer<state_id_type>(from), detail::from_integer<event_id_type>(event),
+                                                  detail::from_integer<state_id_type>(to)};
+            result.push_back({item, count});
+        }
+
+        if (!in.eof())
+        {
+            std::ostringstream error_message {};
+            error_message << "Transition profile is malformed after " << result.size() << " transitions.";
+            throw std::runtime_error(error_message.str());
+        }
+
+        return result;
+    }
+}
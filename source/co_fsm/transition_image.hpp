@@ -0,0 +1,369 @@
+#pragma once
+#ifndef PCH
+    #include <algorithm>
+    #include <array>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstring>
+    #include <fstream>
+    #include <limits>
+    #include <span>
+    #include <sstream>
+    #include <stdexcept>
+    #include <string>
+    #include <type_traits>
+    #include <unordered_map>
+    #include <vector>
+
+    #if __has_include(<sys/mman.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>) && __has_include(<sys/stat.h>)
+        #include <fcntl.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #include <unistd.h>
+        #define CO_FSM_HAS_MMAP 1
+    #endif
+#endif
+
+#ifndef CO_FSM_HAS_MMAP
+    #define CO_FSM_HAS_MMAP 0
+#endif
+
+namespace co_fsm
+{
+    namespace detail
+    {
+        // It is true if the id can be stored in a transition image, i.e. if it is an integral or enumeration id.
+        template <typename _Id>
+        inline constexpr bool is_integer_id = std::is_integral_v<_Id> || std::is_enum_v<_Id>;
+
+        // It returns true if an integral or enumeration id is negative.
+        template <typename _Id>
+        constexpr bool is_negative(const _Id id) noexcept
+        {
+            if constexpr (std::is_enum_v<_Id>)
+                return is_negative(static_cast<std::underlying_type_t<_Id>>(id));
+            else if constexpr (std::is_signed_v<_Id>)
+                return id < 0;
+            else
+                return false;
+        }
+
+        // It converts an integral or enumeration id to an unsigned integer.
+        template <typename _Id>
+        constexpr std::uint64_t to_integer(const _Id id) noexcept
+        {
+            static_assert(is_integer_id<_Id>, "Only integral and enumeration ids are supported.");
+            if constexpr (std::is_enum_v<_Id>)
+                return static_cast<std::uint64_t>(static_cast<std::underlying_type_t<_Id>>(id));
+            else
+                return static_cast<std::uint64_t>(id);
+        }
+
+        // It converts an unsigned integer back to an integral or enumeration id.
+        template <typename _Id>
+        constexpr _Id from_integer(const std::uint64_t value) noexcept
+        {
+            if constexpr (std::is_enum_v<_Id>)
+                return static_cast<_Id>(static_cast<std::underlying_type_t<_Id>>(value));
+            else
+                return static_cast<_Id>(value);
+        }
+    }
+
+    // Binary image of a transition table.
+    // The image is a dense {state index, event} -> target state index table which can be mapped into memory
+    // and used directly by an automaton (see automaton::attach_image) without rebuilding the transition table.
+    //
+    // Layout (native byte order, all offsets are relative to the beginning of the image):
+    //   header                              sizeof(transition_image_header) bytes
+    //   state ids    std::uint64_t[state_count]
+    //   table        std::uint32_t[state_count * event_count], row-major by state index,
+    //                transition_image::npos marks a missing transition.
+    struct transition_image_header
+    {
+        static constexpr std::array<char, 8U> signature {'c', 'o', '_', 'f', 's', 'm', 't', 't'};
+        static constexpr std::uint32_t current_version = 1U;
+        static constexpr std::uint32_t native_byte_order = 0x01020304U;
+
+        std::array<char, 8U> magic {signature};
+        std::uint32_t version {current_version};
+        std::uint32_t byte_order {native_byte_order};
+        std::uint32_t state_count {};
+        std::uint32_t event_count {};
+        std::uint64_t state_ids_offset {};
+        std::uint64_t table_offset {};
+    };
+
+    static_assert(std::is_trivially_copyable_v<transition_image_header>);
+
+    // Read-only view of a transition image. It does not own the memory.
+    class transition_image
+    {
+    public:
+        static inline constexpr auto npos = std::uint32_t(~0U);
+
+        transition_image() noexcept = default;
+
+        // It validates the image stored in 'bytes'. The memory must outlive the view.
+        explicit transition_image(const std::span<const std::byte> bytes)
+        {
+            if (bytes.size() < sizeof(transition_image_header))
+                throw std::runtime_error("Transition image is too small.");
+
+            transition_image_header header {};
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            if (header.magic != transition_image_header::signature)
+                throw std::runtime_error("Transition image has an invalid signature.");
+
+            if (header.byte_order != transition_image_header::native_byte_order)
+                throw std::runtime_error("Transition image has been written with a different byte order.");
+
+            if (header.version != transition_image_header::current_version)
+            {
+                std::ostringstream error_message {};
+                error_message << "Transition image version " << header.version << " is not supported (expected "
+                              << transition_image_header::current_version << ").";
+                throw std::runtime_error(error_message.str());
+            }
+
+            // The counts are 32-bit, so their product doesn't overflow; the offsets are compared with the size before the
+            // sizes of the arrays are added to them.
+            const auto state_count = std::uint64_t(header.state_count);
+            const auto table_size = state_count * header.event_count;
+            const auto fits = [&bytes](const std::uint64_t offset, const std::uint64_t count, const std::size_t item_size)
+            { return offset <= bytes.size() && count <= (bytes.size() - offset) / item_size; };
+            if (header.state_ids_offset % alignof(std::uint64_t) != 0U || header.table_offset % alignof(std::uint32_t) != 0U ||
+                !fits(header.state_ids_offset, state_count, sizeof(std::uint64_t)) ||
+                !fits(header.table_offset, table_size, sizeof(std::uint32_t)) ||
+                reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(std::uint64_t) != 0U)
+                throw std::runtime_error("Transition image is truncated or misaligned.");
+
+            state_ids_ = reinterpret_cast<const std::uint64_t*>(bytes.data() + header.state_ids_offset);
+            table_ = reinterpret_cast<const std::uint32_t*>(bytes.data() + header.table_offset);
+            state_count_ = header.state_count;
+            event_count_ = header.event_count;
+
+            // The automaton resolves the targets without checking them, so a corrupt image is rejected here.
+            for (std::size_t i = 0U; i < table_size; ++i)
+                if (table_[i] >= state_count_ && table_[i] != npos)
+                {
+                    std::ostringstream error_message {};
+                    error_message << "Transition image entry " << i << " refers to state index " << table_[i] << " but the image has "
+                                  << state_count_ << " states.";
+                    throw std::runtime_error(error_message.str());
+                }
+        }
+
+        // It returns true if the view refers to an image.
+        explicit operator bool () const noexcept { return table_ != nullptr; }
+
+        std::uint32_t state_count() const noexcept { return state_count_; }
+        std::uint32_t event_count() const noexcept { return event_count_; }
+
+        // It returns the id of the state at the given index as an integer.
+        std::uint64_t state_id_at(const std::size_t index) const noexcept { return state_ids_[index]; }
+
+        // It returns the number of entries of the table (i.e. state_count * event_count).
+        std::size_t size() const noexcept { return std::size_t(state_count_) * event_count_; }
+
+        // It returns the position of {state, event} in the table or size() if the event is out of the range of the table.
+        std::size_t slot(const std::size_t state_index, const std::uint64_t event_index) const noexcept
+        {
+            return event_index < event_count_ ? state_index * event_count_ + event_index : size();
+        }
+
+        // It returns the index of the target state at the given position or npos if there is no transition.
+        std::uint32_t target_at(const std::size_t slot) const noexcept { return slot < size() ? table_[slot] : npos; }
+
+        // It returns the index of the target state of event 'event_index' sent from the state at 'state_index'.
+        // It returns npos if there is no such transition.
+        std::uint32_t target(const std::size_t state_index, const std::uint64_t event_index) const noexcept
+        {
+            return target_at(slot(state_index, event_index));
+        }
+
+    private:
+        const std::uint64_t* state_ids_ {};
+        const std::uint32_t* table_ {};
+        std::uint32_t state_count_ {};
+        std::uint32_t event_count_ {};
+    };
+
+    // It writes the transition table of 'fsm' as a transition image.
+    // The states are stored in the order of registration (i.e. by the index returned by add_state).
+    // Only transitions within the FSM can be written since transitions to other FSMs refer to objects in memory.
+    template <typename _Fsm>
+    void write_transition_image(const _Fsm& fsm, std::ostream& out)
+    {
+        const auto state_count = fsm.state_count();
+        const auto transitions = fsm.get_transitions();
+
+        std::uint64_t event_count {};
+        for (const auto& transition: transitions)
+        {
+            if (transition.target != nullptr && transition.target != &fsm)
+            {
+                auto error_message = fsm.create_error_message();
+                error_message << "transition from state '" << transition.from << "' on event '" << transition.event
+                              << "' leads to another FSM and can't be written to a transition image.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            // The event ids are the columns of the table, so they must be in [0, npos).
+            if (detail::is_negative(transition.event) || detail::to_integer(transition.event) >= transition_image::npos)
+            {
+                auto error_message = fsm.create_error_message();
+                error_message << "event '" << transition.event << "' of the transition from state '" << transition.from
+                              << "' is out of the range of a transition image.";
+                throw std::runtime_error(error_message.str());
+            }
+
+            event_count = std::max(event_count, detail::to_integer(transition.event) + 1U);
+        }
+
+        // The table must be addressable and its size in bytes must not overflow.
+        if (state_count >= transition_image::npos || event_count >= transition_image::npos ||
+            (event_count != 0U && state_count > std::numeric_limits<std::size_t>::max() / sizeof(std::uint32_t) / event_count))
+        {
+            auto error_message = fsm.create_error_message();
+            error_message << "the transition table is too large for a transition image.";
+            throw std::runtime_error(error_message.str());
+        }
+
+        transition_image_header header {};
+        header.state_count = static_cast<std::uint32_t>(state_count);
+        header.event_count = static_cast<std::uint32_t>(event_count);
+        header.state_ids_offset = sizeof(header);
+        header.table_offset = header.state_ids_offset + state_count * sizeof(std::uint64_t);
+
+        std::vector<std::uint64_t> state_ids(state_count);
+        std::unordered_map<std::uint64_t, std::uint32_t> indices {};
+        indices.reserve(state_count);
+        for (std::size_t i = 0U; i < state_count; ++i)
+        {
+            state_ids[i] = detail::to_integer(fsm.state_id_at(i));
+            indices.emplace(state_ids[i], static_cast<std::uint32_t>(i));
+        }
+
+        std::vector<std::uint32_t> table(state_count * event_count, transition_image::npos);
+        for (const auto& transition: transitions)
+            table[indices.at(detail::to_integer(transition.from)) * event_count + detail::to_integer(transition.event)] =
+                indices.at(detail::to_integer(transition.to));
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(state_ids.data()), std::streamsize(state_ids.size() * sizeof(std::uint64_t)));
+        out.write(reinterpret_cast<const char*>(table.data()), std::streamsize(table.size() * sizeof(std::uint32_t)));
+        if (!out)
+            throw std::runtime_error("Failed to write the transition image.");
+    }
+
+    // It writes the transition table of 'fsm' as a transition image into file 'path'.
+    template <typename _Fsm>
+    void write_transition_image(const _Fsm& fsm, const std::string& path)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::ostringstream error_message {};
+            error_message << "Can't open file '" << path << "' for writing.";
+            throw std::runtime_error(error_message.str());
+        }
+
+        write_transition_image(fsm, out);
+    }
+
+    // Read-only memory mapping of a file (e.g. a transition image).
+    // If memory mapping is not available on the platform, the file is read into memory.
+    class mapped_file
+    {
+    public:
+        mapped_file() noexcept = default;
+
+        explicit mapped_file(const std::string& path)
+        {
+#if CO_FSM_HAS_MMAP
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                throw_error("Can't open file", path);
+
+            struct stat status {};
+            if (::fstat(fd, &status) != 0)
+            {
+                ::close(fd);
+                throw_error("Can't get the size of file", path);
+            }
+
+            size_ = static_cast<std::size_t>(status.st_size);
+            if (size_ != 0U)
+            {
+                void* const address = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (address == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw_error("Can't map file", path);
+                }
+
+                data_ = static_cast<const std::byte*>(address);
+            }
+
+            ::close(fd);
+#else
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in)
+                throw_error("Can't open file", path);
+
+            size_ = static_cast<std::size_t>(in.tellg());
+            buffer_.resize((size_ + sizeof(std::uint64_t) - 1U) / sizeof(std::uint64_t));
+            in.seekg(0);
+            in.read(reinterpret_cast<char*>(buffer_.data()), std::streamsize(size_));
+            if (!in)
+                throw_error("Can't read file", path);
+
+            data_ = reinterpret_cast<const std::byte*>(buffer_.data());
+#endif
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file(mapped_file&& other) noexcept { swap(other); }
+        mapped_file& operator= (const mapped_file&) = delete;
+        mapped_file& operator= (mapped_file&& other) noexcept
+        {
+            mapped_file(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~mapped_file()
+        {
+#if CO_FSM_HAS_MMAP
+            if (data_ != nullptr)
+                ::munmap(const_cast<std::byte*>(data_), size_);
+#endif
+        }
+
+        // It returns the mapped bytes.
+        std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+
+    private:
+        [[noreturn]] static void throw_error(const char* const what, const std::string& path)
+        {
+            std::ostringstream error_message {};
+            error_message << what << " '" << path << "'.";
+            throw std::runtime_error(error_message.str());
+        }
+
+        void swap(mapped_file& other) noexcept
+        {
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+#if !CO_FSM_HAS_MMAP
+            std::swap(buffer_, other.buffer_);
+#endif
+        }
+
+        const std::byte* data_ {};
+        std::size_t size_ {};
+#if !CO_FSM_HAS_MMAP
+        std::vector<std::uint64_t> buffer_ {};
+#endif
+    };
+}
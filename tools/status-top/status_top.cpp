@@ -0,0 +1,207 @@
+#include <co_fsm/status_registry.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Status-top: it attaches read-only to the status registry of a process (see co_fsm::status_registry) and prints the
+// status of its FSMs once, or refreshes it like top with the transition rates sorted in decreasing order.
+//   status-top NAME [--top] [--interval MS] [--lines N]
+namespace co_fsm::status_top
+{
+    struct options
+    {
+        std::string name {};
+        bool top {};
+        unsigned interval_ms {1000U};
+        std::size_t lines {40U};
+
+        // It parses the command line. It throws std::runtime_error if an option is unknown or has no value.
+        static options parse(const int argc, const char* const argv[])
+        {
+            options result {};
+            for (int i = 1; i < argc; ++i)
+            {
+                const std::string_view name {argv[i]};
+                if (name == "--help")
+                {
+                    std::cout << "Usage: " << argv[0] << " NAME [--top] [--interval MS] [--lines N]\n";
+                    std::exit(0);
+                }
+
+                if (name == "--top")
+                {
+                    result.top = true;
+                    continue;
+                }
+
+                if (!name.starts_with("--"))
+                {
+                    result.name = name;
+                    continue;
+                }
+
+                if (i + 1 == argc)
+                    throw std::runtime_error("Option '" + std::string(name) + "' has no value.");
+
+                const std::string value {argv[++i]};
+                if (name == "--interval")
+                    result.interval_ms = std::max(10U, unsigned(std::stoul(value)));
+                else if (name == "--lines")
+                    result.lines = std::max(std::size_t(1U), std::size_t(std::stoul(value)));
+                else
+                    throw std::runtime_error("Unknown option '" + std::string(name) + "'. Try --help.");
+            }
+
+            if (result.name.empty())
+                throw std::runtime_error("The name of the status registry is missing. Try --help.");
+            return result;
+        }
+    };
+
+    // Copy of a slot in use.
+    struct row
+    {
+        std::size_t slot {};
+        std::uint32_t generation {};
+        std::uint32_t flags {};
+        std::uint64_t fsm {};
+        std::uint64_t state {};
+        std::uint64_t event {};
+        std::uint64_t transitions {};
+        std::uint64_t errors {};
+        std::string name {};
+        double rate {}; // Transitions per second since the previous refresh.
+    };
+
+    // It copies the slots in use. A slot which is given to another FSM meanwhile is skipped.
+    std::vector<row> read_rows(const status_registry_view& registry)
+    {
+        std::vector<row> result {};
+        const auto slots = registry.slots();
+        for (std::size_t i = 0U; i < slots.size(); ++i)
+        {
+            const auto& slot = slots[i];
+            row item {i, slot.generation.load(std::memory_order_acquire), slot.flags.load(std::memory_order_acquire)};
+            if ((item.flags & status_slot::in_use) == 0U)
+                continue;
+
+            item.fsm = slot.fsm.load(std::memory_order_relaxed);
+            item.state = slot.state.load(std::memory_order_relaxed);
+            item.event = slot.event.load(std::memory_order_relaxed);
+            item.transitions = slot.transitions.load(std::memory_order_relaxed);
+            item.errors = slot.errors.load(std::memory_order_relaxed);
+            item.name.assign(slot.name, std::find(slot.name, slot.name + status_slot::name_size, '\0'));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.generation.load(std::memory_order_relaxed) == item.generation)
+                result.push_back(std::move(item));
+        }
+
+        return result;
+    }
+
+    std::string flag_text(const std::uint32_t flags)
+    {
+        if ((flags & status_slot::blocked) != 0U)
+            return "blocked";
+        if ((flags & status_slot::paused) != 0U)
+            return "paused";
+        return (flags & status_slot::active) != 0U ? "active" : "idle";
+    }
+
+    void print(const std::vector<row>& rows, const std::size_t lines, const bool with_rate)
+    {
+        std::cout << std::left << std::setw(7) << "SLOT" << std::setw(24) << "FSM" << std::right << std::setw(12) << "STATE"
+                  << std::setw(12) << "EVENT" << std::setw(8) << "FLAGS" << std::setw(16) << "TRANSITIONS";
+        if (with_rate)
+            std::cout << std::setw(14) << "RATE/s";
+        std::cout << std::setw(10) << "ERRORS" << '\n';
+
+        for (std::size_t i = 0U; i < std::min(lines, rows.size()); ++i)
+        {
+            const auto& item = rows[i];
+            std::cout << std::left << std::setw(7) << item.slot << std::setw(24) << item.name.substr(0U, 23U) << std::right
+                      << std::setw(12) << item.state << std::setw(12) << item.event << std::setw(8) << flag_text(item.flags)
+                      << std::setw(16) << item.transitions;
+            if (with_rate)
+                std::cout << std::setw(14) << std::fixed << std::setprecision(0) << item.rate;
+            std::cout << std::setw(10) << item.errors << '\n';
+        }
+
+        if (rows.size() > lines)
+            std::cout << "... " << rows.size() - lines << " more FSMs\n";
+    }
+
+    bool is_alive(const std::int32_t pid) { return ::kill(pid, 0) == 0 || errno != ESRCH; }
+
+    void top(const status_registry_view& registry, const options& settings)
+    {
+        using clock = std::chrono::steady_clock;
+
+        // Transitions of the previous refresh by slot and generation.
+        std::map<std::pair<std::size_t, std::uint32_t>, std::uint64_t> previous {};
+        auto previous_time = clock::now();
+        while (is_alive(registry.pid()))
+        {
+            auto rows = read_rows(registry);
+            const auto now = clock::now();
+            const double seconds = std::chrono::duration<double>(now - previous_time).count();
+            std::map<std::pair<std::size_t, std::uint32_t>, std::uint64_t> current {};
+            std::uint64_t active {}, errors {};
+            for (auto& item: rows)
+            {
+                const std::pair key {item.slot, item.generation};
+                if (const auto it = previous.find(key); it != previous.end() && seconds > 0.0)
+                    item.rate = double(item.transitions - it->second) / seconds;
+                current.emplace(key, item.transitions);
+                active += (item.flags & status_slot::active) != 0U ? 1U : 0U;
+                errors += item.errors;
+            }
+
+            std::stable_sort(rows.begin(), rows.end(), [](const row& left, const row& right) { return left.rate > right.rate; });
+            std::cout << "\x1b[H\x1b[2J" << registry.name() << " (process " << registry.pid() << "): " << rows.size() << " FSMs, "
+                      << active << " active, " << errors << " errors\n\n";
+            print(rows, settings.lines, true);
+            std::cout << std::flush;
+
+            previous = std::move(current);
+            previous_time = now;
+            std::this_thread::sleep_for(std::chrono::milliseconds(settings.interval_ms));
+        }
+
+        std::cout << "The process " << registry.pid() << " has exited.\n";
+    }
+}
+
+int main(const int argc, const char* const argv[])
+{
+    using namespace co_fsm::status_top;
+    try
+    {
+        const auto settings = options::parse(argc, argv);
+        const co_fsm::status_registry_view registry {settings.name};
+        if (settings.top)
+            top(registry, settings);
+        else
+            print(read_rows(registry), std::size_t(-1), false);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}